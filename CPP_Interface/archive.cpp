@@ -0,0 +1,240 @@
+#include "archive.h"
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <functional>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// bytes of a frame of nbp particles
+static uint64_t frameSize(uint64_t nbp)
+{
+    return sizeof(ArchiveFrame) + ARCHIVE_DOUBLES * sizeof(double) * nbp + (sizeof(int32_t) * nbp + 7) / 8 * 8;
+}
+
+// reads the frame index of an archive of size bytes
+//   read:  copies n bytes at an offset of the archive (false if they cannot be read)
+//   index: the frames; without a valid index at the end (e.g. a run killed while appending a
+//          frame), the complete frames are found from the start of the archive
+//   returns false if the file is not an archive
+
+static bool readIndex(std::function<bool(uint64_t, void *, size_t)> const &read, uint64_t size,
+                      std::vector<ArchiveEntry> &index)
+{
+    index.clear();
+    ArchiveHeader header;
+    if (!read(0, &header, sizeof(header)) || memcmp(header.magic, "SPHARC1", 8) != 0 ||
+        header.nDoubles != ARCHIVE_DOUBLES)
+        return false;
+
+    ArchiveTrailer trailer;
+    if (size >= sizeof(ArchiveHeader) + sizeof(ArchiveTrailer) &&
+        read(size - sizeof(trailer), &trailer, sizeof(trailer)) && memcmp(trailer.magic, "SPHIDX1", 8) == 0 &&
+        trailer.index + trailer.nFrames * sizeof(ArchiveEntry) + sizeof(trailer) == size)
+    {
+        index.resize(trailer.nFrames);
+        bool valid = trailer.nFrames == 0 || read(trailer.index, &index[0], trailer.nFrames * sizeof(ArchiveEntry));
+        for (size_t f = 0; f < index.size() && valid; ++f)
+            valid = index[f].offset + frameSize(index[f].nbp) <= trailer.index;
+        if (valid)
+            return true;
+        index.clear();
+    }
+
+    ArchiveFrame frame;
+    for (uint64_t at = sizeof(ArchiveHeader); at + sizeof(frame) <= size && read(at, &frame, sizeof(frame)); at += frame.size)
+    {
+        if (memcmp(frame.magic, "SPHFRM1", 8) != 0 || frame.size != frameSize(frame.nbp) || at + frame.size > size)
+            break;
+        ArchiveEntry entry = {at, frame.nbp, frame.step, frame.time};
+        index.push_back(entry);
+    }
+    return true;
+}
+
+// appends one output to the archive Results/<filename>_archive.bin
+//   step, time: time step and physical time of the output
+//   pos, speed, density, pressure, mass, type: fields of the particles
+//   indices: the particles written, in this order
+//   create: 'true' to start a new archive (otherwise the frame is added at the end; the first
+//           frame added to an existing archive by a run (restart from a checkpoint) also
+//           removes the frames of the previous run that are not before it)
+// the frame replaces the index at the end of the archive, which is written again after it
+// (a failed write is reported, and the next frame is written in its place)
+
+void archiveFrame(std::string const &filename, int step, double time,
+                  std::vector<double> const (&pos)[3], std::vector<double> const (&speed)[3],
+                  std::vector<double> const &density, std::vector<double> const &pressure,
+                  std::vector<double> const &mass, std::vector<int> const &type,
+                  std::vector<int> const &indices, bool create)
+{
+    static std::map<std::string, std::vector<ArchiveEntry>> archives; // index of the archives written by this run
+
+    std::string name = "Results/" + filename + "_archive.bin";
+    bool continued = archives.count(name) != 0;
+    std::vector<ArchiveEntry> &index = archives[name];
+    if (create)
+        index.clear();
+    else if (!continued)
+    {
+        // index of the archive of the previous run, whose frames after this one are removed
+        std::ifstream previous(name.c_str(), std::ios::binary);
+        previous.seekg(0, std::ios::end);
+        uint64_t size = previous.good() ? (uint64_t)previous.tellg() : 0;
+        std::function<bool(uint64_t, void *, size_t)> read = [&previous](uint64_t at, void *values, size_t n) {
+            previous.seekg(at);
+            return (bool)previous.read((char *)values, n);
+        };
+        if (!previous.is_open() || !readIndex(read, size, index))
+            create = true;
+        size_t kept = 0;
+        while (kept < index.size() && index[kept].time < time * (1.0 - 1.0e-9))
+            kept++;
+        if (!create && kept < index.size())
+        {
+            // the archive is cut before the first removed frame
+            uint64_t end = index[kept].offset;
+            index.resize(kept);
+            std::ofstream cut((name + ".tmp").c_str(), std::ios::binary);
+            std::vector<char> block(1 << 20);
+            previous.clear();
+            previous.seekg(0);
+            for (uint64_t at = 0; at < end; at += block.size())
+            {
+                size_t n = std::min((uint64_t)block.size(), end - at);
+                previous.read(&block[0], n);
+                cut.write(&block[0], n);
+            }
+            cut.close();
+            bool copied = !cut.fail() && !previous.fail();
+            previous.close();
+            if (copied)
+            {
+                std::remove(name.c_str());
+                std::rename((name + ".tmp").c_str(), name.c_str());
+            }
+            else
+            {
+                // the removed frames are overwritten in place instead
+                std::cout << "\nCannot cut " << name << " at the restart." << std::endl;
+                std::remove((name + ".tmp").c_str());
+            }
+        }
+    }
+    uint64_t at = index.empty() ? sizeof(ArchiveHeader) : index.back().offset + frameSize(index.back().nbp);
+
+    // frame: header and columns
+    uint64_t nbp = indices.size();
+    std::vector<char> frame(frameSize(nbp), 0);
+    ArchiveFrame header = {"SPHFRM1", frame.size(), nbp, step, time};
+    memcpy(&frame[0], &header, sizeof(header));
+    double *columns = (double *)&frame[sizeof(header)];
+    std::vector<double> const *sources[ARCHIVE_DOUBLES] = {&pos[0], &pos[1], &pos[2], &speed[0], &speed[1],
+                                                           &speed[2], &density, &pressure, &mass};
+    for (int c = 0; c < ARCHIVE_DOUBLES; ++c)
+        for (uint64_t i = 0; i < nbp; ++i)
+            columns[c * nbp + i] = (*sources[c])[indices[i]];
+    int32_t *types = (int32_t *)(columns + ARCHIVE_DOUBLES * nbp);
+    for (uint64_t i = 0; i < nbp; ++i)
+        types[i] = type[indices[i]];
+
+    std::fstream f;
+    if (!create)
+        f.open(name.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+    if (!f.is_open())
+    {
+        ArchiveHeader fileHeader = {"SPHARC1", 1, ARCHIVE_DOUBLES};
+        f.open(name.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+        f.write((char const *)&fileHeader, sizeof(fileHeader));
+        index.clear();
+        at = sizeof(ArchiveHeader);
+    }
+    ArchiveEntry entry = {at, nbp, step, time};
+    index.push_back(entry);
+    ArchiveTrailer trailer = {at + frame.size(), index.size(), "SPHIDX1"};
+    f.seekp(at);
+    f.write(&frame[0], frame.size());
+    f.write((char const *)&index[0], index.size() * sizeof(ArchiveEntry));
+    f.write((char const *)&trailer, sizeof(trailer));
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "\nFrame of step " << step << " not written to " << name << "." << std::endl;
+        index.pop_back();
+    }
+}
+
+// maps an archive and reads its frame index (false if the file is not an archive)
+
+bool ArchiveReader::open(std::string const &name)
+{
+    close();
+#ifdef __linux__
+    int fd = ::open(name.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || status.st_size == 0)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    void *mapped = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+    data = (char const *)mapped;
+    size = status.st_size;
+#else
+    std::ifstream f(name.c_str(), std::ios::binary);
+    buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+#endif
+
+    std::function<bool(uint64_t, void *, size_t)> read = [this](uint64_t at, void *values, size_t n) {
+        if (at + n > size)
+            return false;
+        memcpy(values, data + at, n);
+        return true;
+    };
+    if (!readIndex(read, size, index))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ArchiveReader::close()
+{
+#ifdef __linux__
+    if (data != NULL)
+        munmap((void *)data, size);
+#endif
+    buffer.clear();
+    data = NULL;
+    size = 0;
+    index.clear();
+}
+
+// column of a frame (nbp values)
+
+double const *ArchiveReader::column(size_t frame, ArchiveColumn column) const
+{
+    return (double const *)(data + index[frame].offset + sizeof(ArchiveFrame)) + column * index[frame].nbp;
+}
+
+// types of the particles of a frame (nbp values: 0 = free, 1 = fixed, 2 = moving)
+
+int32_t const *ArchiveReader::type(size_t frame) const
+{
+    return (int32_t const *)column(frame, ARCHIVE_DOUBLES);
+}
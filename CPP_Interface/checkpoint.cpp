@@ -0,0 +1,631 @@
+///**************************************************************************
+/// SOURCE: Checkpoints of the simulation and restart from them.
+///**************************************************************************
+#include "Main.h"
+#include "Interface.h"
+#include "Physics.h"
+#include "Tools.h"
+#include "paraview.h"
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define WALLTIME_RESERVE 30.0 // seconds kept at the end of the walltime besides the last steps and checkpoint
+
+// Set by the stop signals (SIGTERM, SIGUSR1), checked once per time step by checkpointDue
+static volatile std::sig_atomic_t stopSignal = 0;
+
+static void catchStop(int)
+{
+    stopSignal = 1;
+}
+
+// Checkpoint file of a process (native byte order):
+//   char[8] "SPHCHK1"
+//   int32 nTasks, procID | uint64 hashes of the parameter and geometry files
+//   uint32 step, writeCount, loadingBar | double currentTime, k, computeTime
+//   double l[3], u[3] of the global domain (process 0 only, 0 otherwise)
+//   double boxSize, globalL[3] | int32 nTotalBoxes[3]
+//   int32 vectors (size, then values): cutAxis, cutBox, subdomainBoxes
+//   int32 number of moving boundaries nMB, then posLaw, angleLaw (int32), charactTime, amplitude,
+//   teta[3], movingDirection[3], rotationCenter[3] (nMB doubles each)
+//   int32 nbp, then the columns of the particles of the subdomain (halos excluded):
+//   posX, posY, posZ, velocityX, velocityY, velocityZ, density, pressure, mass (doubles), type (int32)
+
+// content of a checkpoint file (the particles are read apart)
+struct CheckpointFile
+{
+    int nTasks;
+    int procID;
+    Checkpoint state;
+    double k;
+    double computeTime;
+    double l[3];
+    double u[3];
+    SubdomainInfo decomposition;
+    Parameter movingBoundaries;
+};
+
+// Two checkpoints are kept, in the slots 0 and 1: a new checkpoint replaces the older one, and the
+// manifest Results/<filename>_checkpoint.txt ("slot step time nTasks"), written last by process 0,
+// names the slot of the last checkpoint written entirely by every process.
+
+// name of the checkpoint file of a process in a slot
+static std::string checkpointName(std::string const &filename, int slot, int procID)
+{
+    std::stringstream s;
+    s << "Results/" << filename << "_checkpoint_" << slot << "_" << std::setw(4) << std::setfill('0') << procID << ".bin";
+    return s.str();
+}
+
+static std::string manifestName(std::string const &filename)
+{
+    return "Results/" + filename + "_checkpoint.txt";
+}
+
+// makes the renames in the directory durable (Linux only)
+static void syncDirectory(std::string const &directory)
+{
+#ifdef __linux__
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+}
+
+// FNV-1a hash of the content of a file (0 if it cannot be read)
+static uint64_t fileHash(std::string const &filename)
+{
+    std::ifstream f(filename.c_str(), std::ios::binary);
+    if (!f.is_open())
+        return 0;
+    uint64_t hash = 14695981039346656037ULL;
+    std::vector<char> buffer(1 << 16);
+    while (f.read(buffer.data(), buffer.size()) || f.gcount() > 0)
+    {
+        for (std::streamsize i = 0; i < f.gcount(); i++)
+            hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// appends n values to data
+template <typename T>
+static void put(std::vector<char> &data, T const *values, size_t n)
+{
+    char const *bytes = (char const *)values;
+    data.insert(data.end(), bytes, bytes + n * sizeof(T));
+}
+
+template <typename T>
+static void putVector(std::vector<char> &data, std::vector<T> const &values)
+{
+    int n = values.size();
+    put(data, &n, 1);
+    put(data, values.data(), n);
+}
+
+// reads n values at position at of data (false if data is too short)
+template <typename T>
+static bool get(std::vector<char> const &data, size_t &at, T *values, size_t n)
+{
+    if (at + n * sizeof(T) > data.size())
+        return false;
+    if (n > 0)
+        memcpy(values, &data[at], n * sizeof(T));
+    at += n * sizeof(T);
+    return true;
+}
+
+template <typename T>
+static bool getVector(std::vector<char> const &data, size_t &at, std::vector<T> &values)
+{
+    int n;
+    if (!get(data, at, &n, 1) || n < 0)
+        return false;
+    values.resize(n);
+    return get(data, at, values.data(), n);
+}
+
+/*
+Input:
+    - name: checkpoint file
+    - file: its content, except the particles
+    - particles: field to which its particles are appended
+Output:
+    - false if the file cannot be read or is not a checkpoint
+*/
+static bool loadCheckpoint(std::string const &name, CheckpointFile &file, Field &particles)
+{
+    std::ifstream f(name.c_str(), std::ios::binary);
+    if (!f.is_open())
+        return false;
+    std::vector<char> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    size_t at = 0;
+    char magic[8];
+    bool ok = get(data, at, magic, 8) && memcmp(magic, "SPHCHK1", 8) == 0;
+
+    Checkpoint &state = file.state;
+    SubdomainInfo &decomposition = file.decomposition;
+    Parameter &mb = file.movingBoundaries;
+    ok = ok && get(data, at, &file.nTasks, 1) && get(data, at, &file.procID, 1);
+    ok = ok && get(data, at, &state.parameterHash, 1) && get(data, at, &state.geometryHash, 1);
+    ok = ok && get(data, at, &state.step, 1) && get(data, at, &state.writeCount, 1) && get(data, at, &state.loadingBar, 1);
+    ok = ok && get(data, at, &state.currentTime, 1) && get(data, at, &file.k, 1) && get(data, at, &file.computeTime, 1);
+    ok = ok && get(data, at, file.l, 3) && get(data, at, file.u, 3);
+    ok = ok && get(data, at, &decomposition.boxSize, 1) && get(data, at, decomposition.globalL, 3);
+    ok = ok && get(data, at, decomposition.nTotalBoxes, 3);
+    ok = ok && getVector(data, at, decomposition.cutAxis) && getVector(data, at, decomposition.cutBox);
+    ok = ok && getVector(data, at, decomposition.subdomainBoxes);
+    ok = ok && getVector(data, at, mb.posLaw);
+    int nMB = mb.posLaw.size();
+    mb.angleLaw.resize(nMB);
+    mb.charactTime.resize(nMB);
+    mb.amplitude.resize(nMB);
+    ok = ok && get(data, at, mb.angleLaw.data(), nMB) && get(data, at, mb.charactTime.data(), nMB);
+    ok = ok && get(data, at, mb.amplitude.data(), nMB);
+    for (int i = 0; i < 3; i++)
+    {
+        mb.teta[i].resize(nMB);
+        mb.movingDirection[i].resize(nMB);
+        mb.rotationCenter[i].resize(nMB);
+        ok = ok && get(data, at, mb.teta[i].data(), nMB) && get(data, at, mb.movingDirection[i].data(), nMB);
+        ok = ok && get(data, at, mb.rotationCenter[i].data(), nMB);
+    }
+
+    int nbp;
+    ok = ok && get(data, at, &nbp, 1) && nbp >= 0;
+    if (!ok)
+        return false;
+    int start = particles.pos[0].size();
+    sizeField(particles, start + nbp);
+    for (int i = 0; i < 3; i++)
+        ok = ok && get(data, at, &particles.pos[i][start], nbp);
+    for (int i = 0; i < 3; i++)
+        ok = ok && get(data, at, &particles.speed[i][start], nbp);
+    ok = ok && get(data, at, &particles.density[start], nbp) && get(data, at, &particles.pressure[start], nbp);
+    ok = ok && get(data, at, &particles.mass[start], nbp) && get(data, at, &particles.type[start], nbp);
+    return ok && at == data.size();
+}
+
+/*
+Input:
+    - value: time limit, in seconds or as [[hh:]mm:]ss (as the --time of SLURM)
+Output:
+    - the number of seconds (negative if the value is invalid)
+*/
+double readWalltime(std::string const &value)
+{
+    std::stringstream s(value);
+    std::string item;
+    double seconds = 0.0;
+    int n = 0;
+    while (std::getline(s, item, ':'))
+    {
+        char *end;
+        double number = strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || number < 0.0 || ++n > 3)
+            return -1.0;
+        seconds = 60.0 * seconds + number;
+    }
+    return (n == 0) ? -1.0 : seconds;
+}
+
+/*
+Input:
+    - checkpoint: checkpoints of the experiment
+    - filename: name of the experiment (the files are Results/<filename>_checkpoint_<slot>_<process>.bin)
+    - parameterFilename, geometryFilename: input files, whose hashes are saved in the checkpoints
+    - subdomainInfo: process 0 hashes the files
+    - restart: 'false' for a new simulation, whose restarts must not use the checkpoints of a
+      previous run of the experiment (their manifest is removed)
+Description:
+    Sets up the checkpoints (called before the field is initialized or restored)
+    and catches the stop signals: a SIGTERM or SIGUSR1 sent by the batch
+    scheduler before the end of the job no longer kills the processes, it makes
+    them write a checkpoint and stop at the end of the time step.
+*/
+void startCheckpoints(Checkpoint &checkpoint, std::string const &filename, std::string const &parameterFilename,
+                      std::string const &geometryFilename, SubdomainInfo &subdomainInfo, bool restart)
+{
+    checkpoint.filename = filename;
+    uint64_t hashes[2] = {0, 0};
+    if (subdomainInfo.procID == 0)
+    {
+        if (!restart)
+            std::remove(manifestName(filename).c_str());
+        hashes[0] = fileHash(parameterFilename);
+        hashes[1] = fileHash(geometryFilename);
+        checkpoint.lastWrite = MPI_Wtime();
+        checkpoint.start = checkpoint.lastWrite;
+        checkpoint.lastStep = checkpoint.lastWrite;
+    }
+    std::signal(SIGTERM, catchStop);
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, catchStop);
+#endif
+    MPI_Bcast(hashes, 2, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    checkpoint.parameterHash = hashes[0];
+    checkpoint.geometryHash = hashes[1];
+}
+
+/*
+Input:
+    - checkpoint: time of the last checkpoint, walltime
+    - step: time step just done
+    - parameter: checkpointInterval and checkpointPeriod
+Output:
+    - true (on every process) if a checkpoint must be written after this step
+    - stop: true (on every process) if the run must stop after this checkpoint
+Description:
+    Called once per time step. The run stops if a process got a stop signal or
+    if the walltime would be exceeded before the end of the next time step and
+    checkpoint: the remaining time must leave two of the longest time steps,
+    two of the longest checkpoints and WALLTIME_RESERVE. The processes agree on
+    the decisions with a single reduction of one integer.
+*/
+bool checkpointDue(Checkpoint &checkpoint, unsigned int step, Parameter *parameter, SubdomainInfo &subdomainInfo,
+                   bool &stop)
+{
+    int flags = stopSignal ? 3 : 0; // 1 = checkpoint, 2 = stop
+    if (parameter->checkpointInterval > 0 && step % parameter->checkpointInterval == 0)
+        flags |= 1;
+
+    // The wall-clock time of process 0 decides
+    if (subdomainInfo.procID == 0)
+    {
+        double now = MPI_Wtime();
+        checkpoint.longestStep = std::max(checkpoint.longestStep, now - checkpoint.lastStep);
+        checkpoint.lastStep = now;
+        if (parameter->checkpointPeriod > 0.0 && now - checkpoint.lastWrite >= parameter->checkpointPeriod)
+            flags |= 1;
+        double reserve = 2.0 * checkpoint.longestStep + 2.0 * checkpoint.longestWrite + WALLTIME_RESERVE;
+        if (checkpoint.walltime > 0.0 && now - checkpoint.start + reserve >= checkpoint.walltime)
+            flags |= 3;
+    }
+    if (subdomainInfo.nTasks > 1)
+        MPI_Allreduce(MPI_IN_PLACE, &flags, 1, MPI_INT, MPI_BOR, MPI_COMM_WORLD);
+    stop = (flags & 2) != 0;
+    return flags != 0;
+}
+
+/*
+Input:
+    - checkpoint: state of the time loop (step, currentTime, writeCount, loadingBar)
+    - field: local field of the process (its halos are not saved)
+    - globalField: bounds of the global domain (process 0)
+    - parameter: time step and moving boundaries
+    - subdomainInfo: decomposition of the domain
+Output:
+    - true (on every process) if the checkpoint was written by every process
+Description:
+    Each process writes its particles and the state of the simulation in its
+    checkpoint file, in a single binary write that bypasses the page cache
+    (O_DIRECT) and is synced to the disk. The files of the new checkpoint replace
+    those of the older of the two checkpoints kept: once every process has written
+    its file, process 0 names the new slot in the manifest (written under a
+    temporary name and renamed). If a process fails (e.g. a full disk), the
+    manifest still names the previous checkpoint.
+*/
+bool writeCheckpoint(Checkpoint &checkpoint, Field *field, Field *globalField, Parameter *parameter,
+                     SubdomainInfo &subdomainInfo)
+{
+    int procID = subdomainInfo.procID;
+    std::vector<char> data;
+    put(data, "SPHCHK1", 8);
+    put(data, &subdomainInfo.nTasks, 1);
+    put(data, &procID, 1);
+    put(data, &checkpoint.parameterHash, 1);
+    put(data, &checkpoint.geometryHash, 1);
+    put(data, &checkpoint.step, 1);
+    put(data, &checkpoint.writeCount, 1);
+    put(data, &checkpoint.loadingBar, 1);
+    put(data, &checkpoint.currentTime, 1);
+    put(data, &parameter->k, 1);
+    put(data, &subdomainInfo.computeTime, 1);
+    double bounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    if (procID == 0)
+    {
+        std::copy(globalField->l, globalField->l + 3, bounds);
+        std::copy(globalField->u, globalField->u + 3, bounds + 3);
+    }
+    put(data, bounds, 6);
+    put(data, &subdomainInfo.boxSize, 1);
+    put(data, subdomainInfo.globalL, 3);
+    put(data, subdomainInfo.nTotalBoxes, 3);
+    putVector(data, subdomainInfo.cutAxis);
+    putVector(data, subdomainInfo.cutBox);
+    putVector(data, subdomainInfo.subdomainBoxes);
+
+    // Moving boundaries
+    int nMB = parameter->posLaw.size();
+    putVector(data, parameter->posLaw);
+    put(data, parameter->angleLaw.data(), nMB);
+    put(data, parameter->charactTime.data(), nMB);
+    put(data, parameter->amplitude.data(), nMB);
+    for (int i = 0; i < 3; i++)
+    {
+        put(data, parameter->teta[i].data(), nMB);
+        put(data, parameter->movingDirection[i].data(), nMB);
+        put(data, parameter->rotationCenter[i].data(), nMB);
+    }
+
+    // Particles of the subdomain
+    int start = subdomainInfo.startingParticle;
+    int nbp = subdomainInfo.endingParticle - start + 1;
+    put(data, &nbp, 1);
+    for (int i = 0; i < 3; i++)
+        put(data, &field->pos[i][start], nbp);
+    for (int i = 0; i < 3; i++)
+        put(data, &field->speed[i][start], nbp);
+    put(data, &field->density[start], nbp);
+    put(data, &field->pressure[start], nbp);
+    put(data, &field->mass[start], nbp);
+    put(data, &field->type[start], nbp);
+
+    double writeStart = MPI_Wtime();
+    std::string name = checkpointName(checkpoint.filename, checkpoint.slot, procID);
+    int written = writeFile(name, "", data, "", true, true) ? 1 : 0;
+    if (!written)
+        std::cout << "\nCheckpoint " << name << " not written." << std::endl;
+    MPI_Allreduce(MPI_IN_PLACE, &written, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+
+    // The manifest commits the checkpoint
+    if (written && procID == 0)
+    {
+        std::stringstream manifest;
+        manifest << std::setprecision(17) << checkpoint.slot << " " << checkpoint.step << " "
+                 << checkpoint.currentTime << " " << subdomainInfo.nTasks << "\n";
+        std::string manifestFile = manifestName(checkpoint.filename);
+        written = writeFile(manifestFile + ".tmp", manifest.str(), std::vector<char>(), "", false, true) &&
+                  std::rename((manifestFile + ".tmp").c_str(), manifestFile.c_str()) == 0;
+        syncDirectory("Results");
+    }
+    MPI_Bcast(&written, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (written)
+        checkpoint.slot = 1 - checkpoint.slot;
+    else if (procID == 0)
+        std::cout << "\nCheckpoint of step " << checkpoint.step << " not written: the previous checkpoint is kept."
+                  << std::endl;
+
+    if (procID == 0)
+    {
+        checkpoint.lastWrite = MPI_Wtime();
+        checkpoint.longestWrite = std::max(checkpoint.longestWrite, checkpoint.lastWrite - writeStart);
+        checkpoint.lastStep = checkpoint.lastWrite;
+    }
+    return written != 0;
+}
+
+/*
+Input:
+    - slot: slot of the checkpoint to restore
+    - step: its time step named by the manifest (negative if unknown)
+    - checkpoint, localField, globalField, parameter, subdomainInfo: see readCheckpoint
+Output:
+    - errorFlag: restartError (on every process) if the checkpoint of the slot cannot be used,
+      in which case the fields and the decomposition are not changed
+Description:
+    With the same number of processes and the same boxes, each process reads its
+    own file and gets its subdomain back. Otherwise, process 0 reads all the files
+    and the particles are scattered as at the beginning of a simulation (and
+    balanced if balanceInterval is set). A different geometry file is an error; a
+    different parameter file is only reported (e.g. a longer T).
+*/
+static Error restoreCheckpoint(int slot, int step, Checkpoint &checkpoint, Field *localField, Field *globalField,
+                               Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    int procID = subdomainInfo.procID;
+    int nTasks = subdomainInfo.nTasks;
+    CheckpointFile file;
+    Field particles;
+
+    // Process 0 reads its file first: the checkpoint is restored as it is if it has the same decomposition
+    int sameDecomposition = 0;
+    Error errorFlag = noError;
+    if (procID == 0)
+    {
+        std::string name = checkpointName(checkpoint.filename, slot, 0);
+        if (!loadCheckpoint(name, file, particles))
+        {
+            std::cout << "Cannot read the checkpoint " << name << ".\n"
+                      << std::endl;
+            errorFlag = restartError;
+        }
+        else if (step >= 0 && file.state.step != (unsigned int)step)
+        {
+            std::cout << "The checkpoint " << name << " is not that of step " << step << " named by the manifest.\n"
+                      << std::endl;
+            errorFlag = restartError;
+        }
+        else
+        {
+            sameDecomposition = (file.nTasks == nTasks &&
+                                 file.decomposition.boxSize == boxSizeCalc(parameter->kh, parameter->integrationMethod));
+            if (file.state.parameterHash != checkpoint.parameterHash)
+                std::cout << "Warning: the parameter file has changed since the checkpoint." << std::endl;
+            std::cout << "Restart from step " << file.state.step << " (time " << file.state.currentTime << ") of "
+                      << file.nTasks << " process(es)" << (sameDecomposition ? "" : ", particles redistributed")
+                      << std::endl;
+        }
+    }
+    MPI_Bcast(&errorFlag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (errorFlag != noError)
+        return errorFlag;
+    MPI_Bcast(&sameDecomposition, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (sameDecomposition)
+    {
+        // Each process reads its own file
+        std::string name = checkpointName(checkpoint.filename, slot, procID);
+        if (procID != 0 && !loadCheckpoint(name, file, particles))
+        {
+            std::cout << "Cannot read the checkpoint " << name << ".\n"
+                      << std::endl;
+            errorFlag = restartError;
+        }
+        else if (file.nTasks != nTasks || file.procID != procID || file.state.geometryHash != checkpoint.geometryHash)
+        {
+            std::cout << "The checkpoint " << name << " does not match this experiment.\n"
+                      << std::endl;
+            errorFlag = restartError;
+        }
+    }
+    else if (procID == 0)
+    {
+        // Process 0 gathers the particles of all the files
+        sizeField(*globalField, 0);
+        for (int proc = 0; proc < file.nTasks && errorFlag == noError; proc++)
+        {
+            CheckpointFile other;
+            std::string name = checkpointName(checkpoint.filename, slot, proc);
+            if (!loadCheckpoint(name, other, *globalField))
+            {
+                std::cout << "Cannot read the checkpoint " << name << ".\n"
+                          << std::endl;
+                errorFlag = restartError;
+            }
+            else if (other.nTasks != file.nTasks || other.procID != proc || other.state.step != file.state.step ||
+                     other.state.geometryHash != checkpoint.geometryHash)
+            {
+                std::cout << "The checkpoint " << name << " does not match this experiment.\n"
+                          << std::endl;
+                errorFlag = restartError;
+            }
+        }
+    }
+
+    // All the files must be those of the same time step
+    MPI_Allreduce(MPI_IN_PLACE, &errorFlag, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (errorFlag == noError && sameDecomposition)
+    {
+        unsigned int steps[2] = {file.state.step, file.state.step};
+        MPI_Allreduce(MPI_IN_PLACE, &steps[0], 1, MPI_UNSIGNED, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &steps[1], 1, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
+        if (steps[0] != steps[1])
+        {
+            if (procID == 0)
+                std::cout << "The checkpoint files are not those of the same time step.\n"
+                          << std::endl;
+            errorFlag = restartError;
+        }
+    }
+    if (errorFlag != noError)
+        return errorFlag;
+
+    // State of the time loop, time step and moving boundaries (from the file of process 0)
+    double values[2] = {file.state.currentTime, file.k};
+    unsigned int counters[3] = {file.state.step, file.state.writeCount, file.state.loadingBar};
+    MPI_Bcast(values, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(counters, 3, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    checkpoint.currentTime = values[0];
+    parameter->k = values[1];
+    checkpoint.step = counters[0];
+    checkpoint.writeCount = counters[1];
+    checkpoint.loadingBar = counters[2];
+    if (procID == 0)
+    {
+        std::copy(file.l, file.l + 3, globalField->l);
+        std::copy(file.u, file.u + 3, globalField->u);
+    }
+    Parameter &mb = file.movingBoundaries;
+    parameter->posLaw = mb.posLaw;
+    parameter->angleLaw = mb.angleLaw;
+    parameter->charactTime = mb.charactTime;
+    parameter->amplitude = mb.amplitude;
+    for (int i = 0; i < 3; i++)
+    {
+        parameter->teta[i] = mb.teta[i];
+        parameter->movingDirection[i] = mb.movingDirection[i];
+        parameter->rotationCenter[i] = mb.rotationCenter[i];
+    }
+
+    if (!sameDecomposition)
+    {
+        // Scattered as an initial field (the moving boundaries of process 0 are broadcast)
+        errorFlag = scatterField(globalField, localField, parameter, subdomainInfo);
+        if (errorFlag == noError && parameter->balanceInterval > 0)
+            balanceLoad(*localField, parameter, subdomainInfo);
+        return errorFlag;
+    }
+
+    // Same subdomains: the particles that left their subdomain (haloSkin) are sent to their owner
+    SubdomainInfo &decomposition = file.decomposition;
+    subdomainInfo.boxSize = decomposition.boxSize;
+    subdomainInfo.haloDepth = 1 + parameter->haloSkin;
+    std::copy(decomposition.globalL, decomposition.globalL + 3, subdomainInfo.globalL);
+    std::copy(decomposition.nTotalBoxes, decomposition.nTotalBoxes + 3, subdomainInfo.nTotalBoxes);
+    subdomainInfo.cutAxis.swap(decomposition.cutAxis);
+    subdomainInfo.cutBox.swap(decomposition.cutBox);
+    subdomainInfo.subdomainBoxes.swap(decomposition.subdomainBoxes);
+    subdomainInfo.computeTime = file.computeTime;
+    for (int i = 0; i < 3; i++)
+    {
+        localField->pos[i].swap(particles.pos[i]);
+        localField->speed[i].swap(particles.speed[i]);
+    }
+    localField->density.swap(particles.density);
+    localField->pressure.swap(particles.pressure);
+    localField->mass.swap(particles.mass);
+    localField->type.swap(particles.type);
+    subdomainBounds(*localField, subdomainInfo);
+    redistributeParticles(*localField, subdomainInfo);
+    setupLocalField(*localField, parameter, subdomainInfo);
+    return noError;
+}
+
+/*
+Input:
+    - checkpoint: hashes of the input files (see startCheckpoints)
+    - localField: local field to restore
+    - globalField: its bounds are set to the global domain (process 0 also uses it
+      to gather the particles if the number of processes changed)
+    - parameter: its time step and moving boundaries are restored
+    - subdomainInfo: its decomposition is restored
+Output:
+    - errorFlag: restartError (on every process) if no checkpoint can be used
+    - checkpoint: step, currentTime, writeCount and loadingBar of the checkpoint
+Description:
+    Restarts from the last checkpoint of the experiment, named by the manifest.
+    If its files cannot be used (e.g. they were damaged after being written), the
+    previous checkpoint, in the other slot, is restored instead.
+*/
+Error readCheckpoint(Checkpoint &checkpoint, Field *localField, Field *globalField, Parameter *parameter,
+                     SubdomainInfo &subdomainInfo)
+{
+    // Slot and step of the last checkpoint (process 0)
+    int manifest[2] = {-1, -1};
+    if (subdomainInfo.procID == 0)
+    {
+        std::ifstream f(manifestName(checkpoint.filename).c_str());
+        if (!(f >> manifest[0] >> manifest[1]) || (manifest[0] != 0 && manifest[0] != 1))
+        {
+            std::cout << "No checkpoint of the experiment (" << manifestName(checkpoint.filename) << ").\n"
+                      << std::endl;
+            manifest[0] = -1;
+        }
+    }
+    MPI_Bcast(manifest, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    if (manifest[0] < 0)
+        return restartError;
+
+    int slot = manifest[0];
+    Error errorFlag = restoreCheckpoint(slot, manifest[1], checkpoint, localField, globalField, parameter, subdomainInfo);
+    if (errorFlag != noError)
+    {
+        slot = 1 - slot;
+        if (subdomainInfo.procID == 0)
+            std::cout << "Trying the previous checkpoint." << std::endl;
+        errorFlag = restoreCheckpoint(slot, -1, checkpoint, localField, globalField, parameter, subdomainInfo);
+    }
+    checkpoint.slot = 1 - slot; // the next checkpoint replaces the other one
+    return errorFlag;
+}
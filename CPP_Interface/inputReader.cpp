@@ -24,6 +24,7 @@ enum geomType
 *- currentField: Pointer to the structure to fill
 *- posFree/posFree/posMoving: vector to store the position of the particles generated during brick reading
 *- volVectorFree/Fixed/Moving: vector to store the volume of the particles generated during brick reading
+*- region: if not NULL, only the particles of the subdomain of this process are generated
 *Decscription:
 *Read a brick from the geometry file and generate the position and the volume of the particle inside the brick and store these information in the corresponding vectors.
 */
@@ -31,7 +32,8 @@ Error readBrick(int type, std::ifstream *inFile, Parameter *parameter, std::vect
                 std::vector<double> *posMoving, std::vector<double> *posFixed,
                 std::vector<double> *volVectorFree, std::vector<double> *volVectorFixed, 
                 std::vector<double> *volVectorMoving, std::vector<int> *typeFree,
-                std::vector<int> *typeFixed, std::vector<int> *typeMoving, int *numberMovingBoundaries)
+                std::vector<int> *typeFixed, std::vector<int> *typeMoving, int *numberMovingBoundaries,
+                SubdomainInfo *region)
 {
     std::string buf;
     int cnt = 0;
@@ -93,10 +95,10 @@ Error readBrick(int type, std::ifstream *inFile, Parameter *parameter, std::vect
         switch (type)
         {
         case cube:
-            meshcube(o, L, teta, s, *posFree, &nPart, &volPart, r, true);
+            meshcube(o, L, teta, s, *posFree, &nPart, &volPart, r, true, region);
             break;
         case cylinder:
-            meshcylinder(o, L, s, *posFree, &nPart, &volPart, r, true);
+            meshcylinder(o, L, s, *posFree, &nPart, &volPart, r, true, region);
             break;
         case sphere:
             meshsphere(o, L, s, *posFree, &nPart, &volPart, r, true);
@@ -112,10 +114,10 @@ Error readBrick(int type, std::ifstream *inFile, Parameter *parameter, std::vect
         switch (type)
         {
         case cube:
-            meshcube(o, L, teta, s, *posFixed, &nPart, &volPart, r, true);
+            meshcube(o, L, teta, s, *posFixed, &nPart, &volPart, r, true, region);
             break;
         case cylinder:
-            meshcylinder(o, L, s, *posFixed, &nPart, &volPart, r, true);
+            meshcylinder(o, L, s, *posFixed, &nPart, &volPart, r, true, region);
             break;
         case sphere:
             meshsphere(o, L, s, *posFixed, &nPart, &volPart, r, true);
@@ -146,10 +148,10 @@ Error readBrick(int type, std::ifstream *inFile, Parameter *parameter, std::vect
         switch (type)
         {
         case cube:
-            meshcube(o, L, teta, s, *posMoving, &nPart, &volPart, r, true);
+            meshcube(o, L, teta, s, *posMoving, &nPart, &volPart, r, true, region);
             break;
         case cylinder:
-            meshcylinder(o, L, s, *posMoving, &nPart, &volPart, r, true);
+            meshcylinder(o, L, s, *posMoving, &nPart, &volPart, r, true, region);
             break;
         case sphere:
             meshsphere(o, L, s, *posMoving, &nPart, &volPart, r, true);
@@ -172,10 +174,12 @@ Error readBrick(int type, std::ifstream *inFile, Parameter *parameter, std::vect
 *- currentField: Pointer to the structure to fill
 *- posFree/posFree/posMoving: vector to store the position of the particles generated during brick reading
 *- volVectorFree/Fixed/Moving: vector to store the volume of the particles generated during brick reading
+*- region: if not NULL, only the particles of the subdomain of this process are generated
 *Decscription:
 */
 Error readBathymetry(std::ifstream *inFile, std::vector<double> *posFree, std::vector<double> *posFixed,
-                     std::vector<double> *volVectorFree, std::vector<double> *volVectorFixed, std::vector<int> *typeFree, std::vector<int> *typeFixed)
+                     std::vector<double> *volVectorFree, std::vector<double> *volVectorFixed, std::vector<int> *typeFree, std::vector<int> *typeFixed,
+                     SubdomainInfo *region)
 {
     std::string buf;
     char batFile[64];
@@ -209,7 +213,7 @@ Error readBathymetry(std::ifstream *inFile, std::vector<double> *posFree, std::v
     double volPart;
 
     if (meshBathymetry(batFile, bathType, numberGroundParticles, height0, hFreeSurface, s, *posFree, *posFixed, &nPartFree, &nPartFixed, &volPart,
-                       r, true) != noError)
+                       r, true, region) != noError)
     {
         return geometryError;
     }
@@ -231,13 +235,16 @@ Error readBathymetry(std::ifstream *inFile, std::vector<double> *posFree, std::v
 *Input:
 *- filename: name of the geometry file to read
 *- volVector: vector to store the volume of the particles generated during reading the whole geometry
+*- region: if not NULL, the domain is decomposed as soon as its size is read and only the particles of the
+*  subdomain of this process are generated (called by all the processes)
 *Output:
 *- 1: error
 *- 0: no error
 *Decscription:
 *Read a entire geometry file and generate the position and the volume of the particles and store these informations in a structure.
 */
-Error readGeometry(std::string filename, Field *currentField, Parameter *parameter, std::vector<double> *volVector)
+Error readGeometry(std::string filename, Field *currentField, Parameter *parameter, std::vector<double> *volVector,
+                   SubdomainInfo *region)
 {
     int numberMovingBoundaries = 0;
     std::vector<double> posFree, posFixed, posMoving, volVectorFree, volVectorFixed, volVectorMoving;
@@ -317,12 +324,26 @@ Error readGeometry(std::string filename, Field *currentField, Parameter *paramet
                                   << std::endl;
                         return geometryError;
                     }
+                    // Subdomains known before the particles are generated
+                    if (region != NULL)
+                    {
+                        Error errorFlag = initDecomposition(*currentField, parameter, *region);
+                        if (errorFlag != noError)
+                            return errorFlag;
+                    }
+                }
+                else if (region != NULL && region->subdomainBoxes.empty() &&
+                         (buf == "brick" || buf == "cylin" || buf == "spher" || buf == "bathy"))
+                {
+                    std::cout << "The domain size (#domsz) must be given before the particles.\n"
+                              << std::endl;
+                    return geometryError;
                 }
                 else if (buf == "brick")
                 {
                     if (readBrick(cube, &inFile, parameter, &posFree, &posMoving, &posFixed,
                                   &volVectorFree, &volVectorFixed, &volVectorMoving, &typeFree,
-                                  &typeFixed, &typeMoving, &numberMovingBoundaries) == geometryError)
+                                  &typeFixed, &typeMoving, &numberMovingBoundaries, region) == geometryError)
                     {
                         return geometryError;
                     }
@@ -331,7 +352,7 @@ Error readGeometry(std::string filename, Field *currentField, Parameter *paramet
                 {
                     if (readBrick(cylinder, &inFile, parameter, &posFree, &posMoving, &posFixed,
                                   &volVectorFree, &volVectorFixed, &volVectorMoving, &typeFree,
-                                  &typeFixed, &typeMoving, &numberMovingBoundaries) == geometryError)
+                                  &typeFixed, &typeMoving, &numberMovingBoundaries, region) == geometryError)
                     {
                         return geometryError;
                     }
@@ -340,7 +361,7 @@ Error readGeometry(std::string filename, Field *currentField, Parameter *paramet
                 {
                     if (readBrick(sphere, &inFile, parameter, &posFree, &posMoving, &posFixed,
                                   &volVectorFree, &volVectorFixed, &volVectorMoving, &typeFree,
-                                  &typeFixed, &typeMoving, &numberMovingBoundaries) == geometryError)
+                                  &typeFixed, &typeMoving, &numberMovingBoundaries, region) == geometryError)
                     {
                         return geometryError;
                     }
@@ -348,7 +369,7 @@ Error readGeometry(std::string filename, Field *currentField, Parameter *paramet
                 else if (buf == "bathy")
                 {
                     if (readBathymetry(&inFile, &posFree, &posFixed,
-                                       &volVectorFree, &volVectorFixed, &typeFree, &typeFixed) != noError)
+                                       &volVectorFree, &volVectorFixed, &typeFree, &typeFixed, region) != noError)
                     {
                         return geometryError;
                     }
@@ -402,28 +423,306 @@ Error readGeometry(std::string filename, Field *currentField, Parameter *paramet
 
 /*
 Read the geometry and make all particle initializations
+(only the particles of the subdomain of this process if region is not NULL)
 */
-Error initializeField(std::string filename, Field *currentField, Parameter *parameter)
+Error initializeField(std::string filename, Field *currentField, Parameter *parameter, SubdomainInfo *region)
 {
     std::vector<double> volVector;
-    Error errorFlag = readGeometry(filename, currentField, parameter, &volVector);
+    Error errorFlag = readGeometry(filename, currentField, parameter, &volVector, region);
     if (errorFlag != noError)
         return errorFlag;
 
-    // Checking consistency of user datas
+    // Checking consistency of user datas (on all the processes before the collective density initialization)
     errorFlag = consistencyField(currentField);
+    if (region != NULL)
+        MPI_Allreduce(MPI_IN_PLACE, &errorFlag, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
     if (errorFlag != noError)
         return errorFlag;
 
     // Initialisation of the particles
     speedInit(currentField, parameter);
-    densityInit(currentField, parameter);
+    densityInit(currentField, parameter, (region == NULL) ? MPI_COMM_SELF : MPI_COMM_WORLD);
     pressureInit(currentField, parameter);
     massInit(currentField, parameter, volVector);
 
     return noError;
 }
 
+/*
+*Input:
+*- inFile: Pointer to the input stream, positioned just after an optional section tag
+*- values: list to fill with the "name=value" pairs of the section (in the order of the file)
+*Decscription:
+*Read the named values of an optional section until the next '#' tag (which is left in the stream).
+*Unlike #param, the values of optional sections are identified by their name and may be omitted.
+*/
+void readNamedValues(std::ifstream *inFile, std::vector<std::pair<std::string, std::string>> &values)
+{
+    std::string buf;
+    while (inFile->peek() != std::ifstream::traits_type::eof())
+    {
+        std::streampos lineStart = inFile->tellg();
+        std::getline(*inFile, buf);
+        buf.erase(std::remove(buf.begin(), buf.end(), ' '), buf.end());
+        if (buf.size() == 0 || buf[0] == '%')
+            continue;
+        if (buf[0] == '#')
+        {
+            inFile->seekg(lineStart);
+            return;
+        }
+        size_t equal = buf.find('=');
+        if (equal != std::string::npos)
+            values.push_back(std::make_pair(buf.substr(0, equal), buf.substr(equal + 1)));
+    }
+}
+
+// Same, in a map (the last value of a name is kept)
+void readNamedValues(std::ifstream *inFile, std::map<std::string, std::string> &values)
+{
+    std::vector<std::pair<std::string, std::string>> list;
+    readNamedValues(inFile, list);
+    for (unsigned int i = 0; i < list.size(); i++)
+        values[list[i].first] = list[i].second;
+}
+
+/*
+*Input:
+*- inFile: Pointer to the input stream associated to the parameter file
+*- parameter: pointer the the structure to fill
+*Decscription:
+*Read the optional "#paral" section (parallel options). Omitted values keep their default.
+*/
+Error readParallel(std::ifstream *inFile, Parameter *parameter)
+{
+    std::map<std::string, std::string> values;
+    readNamedValues(inFile, values);
+    for (std::map<std::string, std::string>::iterator it = values.begin(); it != values.end(); ++it)
+    {
+        const char *valueArray = it->second.c_str();
+        if (it->first == "balanceInterval")
+            parameter->balanceInterval = atoi(valueArray);
+        else if (it->first == "haloSkin")
+            parameter->haloSkin = atoi(valueArray);
+        else if (it->first == "distributedInit")
+            parameter->distributedInit = atoi(valueArray);
+        else if (it->first == "balanceTolerance")
+            parameter->balanceTolerance = atof(valueArray);
+        else if (it->first == "balanceMeasure")
+        {
+            if ((0 <= atoi(valueArray)) && (atoi(valueArray) < NB_BALANCEMEASURE_VALUE))
+                parameter->balanceMeasure = (BalanceMeasure)atoi(valueArray);
+            else
+            {
+                std::cout << "Invalid balanceMeasure.\n"
+                          << std::endl;
+                return parameterError;
+            }
+        }
+        else if (it->first == "parallelOutput")
+        {
+            if ((0 <= atoi(valueArray)) && (atoi(valueArray) < NB_PARALLELOUTPUT_VALUE))
+                parameter->parallelOutput = (ParallelOutput)atoi(valueArray);
+            else
+            {
+                std::cout << "Invalid parallelOutput.\n"
+                          << std::endl;
+                return parameterError;
+            }
+        }
+        else if (it->first == "decomposition")
+        {
+            if ((0 <= atoi(valueArray)) && (atoi(valueArray) < NB_DECOMPOSITION_VALUE))
+                parameter->decomposition = (DecompositionMethod)atoi(valueArray);
+            else
+            {
+                std::cout << "Invalid decomposition.\n"
+                          << std::endl;
+                return parameterError;
+            }
+        }
+        else
+        {
+            std::cout << "Unknown '" << it->first << "' parallel parameter.\n"
+                      << std::endl;
+            return parameterError;
+        }
+    }
+    return noError;
+}
+
+/*
+*Input:
+*- value: comma separated numbers ("x,y,z,...")
+*- n: number of values expected
+*- values: the numbers read
+*Output:
+*- true if exactly n numbers are read
+*/
+static bool readList(std::string const &value, unsigned int n, std::vector<double> &values)
+{
+    std::stringstream s(value);
+    std::string item;
+    values.clear();
+    while (std::getline(s, item, ','))
+    {
+        char *end;
+        values.push_back(strtod(item.c_str(), &end));
+        if (item.empty() || *end != '\0')
+            return false;
+    }
+    return values.size() == n;
+}
+
+/*
+*Input:
+*- inFile: Pointer to the input stream associated to the parameter file
+*- parameter: pointer the the structure to fill
+*Decscription:
+*Read the optional "#outpt" section (output options). Omitted values keep their default.
+*/
+Error readOutput(std::ifstream *inFile, Parameter *parameter)
+{
+    std::map<std::string, std::string> values;
+    readNamedValues(inFile, values);
+    for (std::map<std::string, std::string>::iterator it = values.begin(); it != values.end(); ++it)
+    {
+        const char *valueArray = it->second.c_str();
+        if (it->first == "asyncWrite")
+            parameter->asyncWrite = atoi(valueArray);
+        else if (it->first == "compressionLevel")
+            parameter->compressionLevel = atoi(valueArray);
+        else if (it->first == "compressionFilter")
+            parameter->compressionFilter = atoi(valueArray);
+        else if (it->first == "directWrite")
+            parameter->directWrite = atoi(valueArray);
+        else if (it->first == "staticBoundary")
+            parameter->staticBoundary = atoi(valueArray);
+        else if (it->first == "skipUnchanged")
+            parameter->skipUnchanged = atoi(valueArray);
+        else if (it->first == "archive")
+            parameter->archive = atoi(valueArray);
+        else if (it->first == "freeSurface")
+            parameter->freeSurface = atoi(valueArray);
+        else if (it->first == "surfaceThreshold")
+            parameter->surfaceThreshold = atof(valueArray);
+        else if (it->first == "stride")
+            parameter->stride = atoi(valueArray);
+        else if (it->first == "checkpointInterval")
+            parameter->checkpointInterval = atoi(valueArray);
+        else if (it->first == "checkpointPeriod")
+            parameter->checkpointPeriod = atof(valueArray);
+        else if (it->first == "minSpeed")
+            parameter->minSpeed = atof(valueArray);
+        else if (it->first == "minPressure")
+            parameter->minPressure = atof(valueArray);
+        else if (it->first == "roi")
+        {
+            if (!readList(it->second, 6, parameter->roi))
+            {
+                std::cout << "Invalid roi (lx,ly,lz,ux,uy,uz expected).\n"
+                          << std::endl;
+                return parameterError;
+            }
+        }
+        else if (it->first == "fields")
+        {
+            // comma separated names of the arrays (none if empty)
+            std::stringstream names(it->second);
+            std::string name;
+            parameter->fields.clear();
+            while (std::getline(names, name, ','))
+            {
+                if (name != "pressure" && name != "density" && name != "velocity" && name != "mass")
+                {
+                    std::cout << "Unknown '" << name << "' output field.\n"
+                              << std::endl;
+                    return parameterError;
+                }
+                parameter->fields.push_back(name);
+            }
+        }
+        else
+        {
+            std::cout << "Unknown '" << it->first << "' output parameter.\n"
+                      << std::endl;
+            return parameterError;
+        }
+    }
+    return noError;
+}
+
+/*
+*Input:
+*- inFile: Pointer to the input stream associated to the parameter file
+*- parameter: pointer the the structure to fill
+*Decscription:
+*Read the optional "#probe" section: the sampling interval and the probes (point, line,
+*plane and gauge), whose sampled positions are generated here in the order of the file.
+*/
+Error readProbes(std::ifstream *inFile, Parameter *parameter)
+{
+    std::vector<std::pair<std::string, std::string>> values;
+    readNamedValues(inFile, values);
+    for (unsigned int p = 0; p < values.size(); p++)
+    {
+        std::string const &name = values[p].first;
+        std::vector<double> v;
+        Probe probe;
+        if (name == "interval")
+        {
+            parameter->probeInterval = atoi(values[p].second.c_str());
+            continue;
+        }
+        else if (name == "point" && readList(values[p].second, 3, v))
+        {
+            probe.type = pointProbe;
+            for (int i = 0; i < 3; i++)
+                probe.pos[i].push_back(v[i]);
+        }
+        else if (name == "line" && readList(values[p].second, 7, v) && v[6] >= 2)
+        {
+            // n points from (x0,y0,z0) to (x1,y1,z1)
+            probe.type = lineProbe;
+            int n = (int)v[6];
+            for (int a = 0; a < n; a++)
+                for (int i = 0; i < 3; i++)
+                    probe.pos[i].push_back(v[i] + (v[3 + i] - v[i]) * a / (n - 1));
+        }
+        else if (name == "plane" && readList(values[p].second, 11, v) && v[9] >= 2 && v[10] >= 2)
+        {
+            // n1 x n2 points of the parallelogram of corner (x0,y0,z0) and adjacent corners (x1,y1,z1), (x2,y2,z2)
+            probe.type = planeProbe;
+            int n1 = (int)v[9], n2 = (int)v[10];
+            for (int a = 0; a < n1; a++)
+                for (int b = 0; b < n2; b++)
+                    for (int i = 0; i < 3; i++)
+                        probe.pos[i].push_back(v[i] + (v[3 + i] - v[i]) * a / (n1 - 1) +
+                                               (v[6 + i] - v[i]) * b / (n2 - 1));
+        }
+        else if (name == "gauge" && readList(values[p].second, 5, v) && v[4] >= 2 && v[2] < v[3])
+        {
+            // n points of the vertical (x,y) from z0 to z1
+            probe.type = gaugeProbe;
+            int n = (int)v[4];
+            for (int a = 0; a < n; a++)
+            {
+                probe.pos[0].push_back(v[0]);
+                probe.pos[1].push_back(v[1]);
+                probe.pos[2].push_back(v[2] + (v[3] - v[2]) * a / (n - 1));
+            }
+        }
+        else
+        {
+            std::cout << "Invalid '" << name << "' probe.\n"
+                      << std::endl;
+            return parameterError;
+        }
+        parameter->probes.push_back(probe);
+    }
+    return noError;
+}
+
 /*
 *Input:
 *- filename: name of the parameter file to read
@@ -629,6 +928,21 @@ Error readParameter(std::string filename, Parameter *parameter)
                     return parameterError;
                 }
             }
+            else if (buf == "paral")
+            {
+                if (readParallel(&inFile, parameter) != noError)
+                    return parameterError;
+            }
+            else if (buf == "outpt")
+            {
+                if (readOutput(&inFile, parameter) != noError)
+                    return parameterError;
+            }
+            else if (buf == "probe")
+            {
+                if (readProbes(&inFile, parameter) != noError)
+                    return parameterError;
+            }
             else if (buf == "END_F")
             {
                 // Checks finally if the input parameters are consistent (node 0 only)
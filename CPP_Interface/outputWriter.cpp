@@ -0,0 +1,189 @@
+///**************************************************************************
+/// SOURCE: Background writer of the results (asyncWrite).
+///**************************************************************************
+#include "Main.h"
+#include "Interface.h"
+#include "Physics.h"
+#include "Tools.h"
+
+/*
+Input:
+    - writer: the writer whose snapshots are written, in the order they are queued
+Description:
+    Body of the writer thread: waits for a queued snapshot, writes it without
+    holding the lock (the solver may fill the other snapshot meanwhile) and
+    frees it. Returns once stop is set and every queued snapshot is written.
+*/
+static void outputThread(OutputWriter *writer)
+{
+    int slot = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(writer->mutex);
+            writer->changed.wait(lock, [writer, slot] { return writer->pending[slot] || writer->stop; });
+            if (!writer->pending[slot])
+                return;
+        }
+
+        // The snapshot holds only the particles to write
+        Field &field = writer->snapshot[slot];
+        if (writer->pieces != NULL)
+        {
+            SubdomainInfo piece;
+            piece.procID = writer->pieces->procID;
+            piece.nTasks = writer->pieces->nTasks;
+            piece.startingParticle = 0;
+            piece.endingParticle = field.pos[0].size() - 1;
+            piece.background = true;
+            writeField(&field, writer->step[slot], &writer->parameter[slot], writer->parameterFilename,
+                       writer->geometryFilename, writer->filename, &piece);
+        }
+        else
+            writeField(&field, writer->step[slot], &writer->parameter[slot], writer->parameterFilename,
+                       writer->geometryFilename, writer->filename);
+
+        {
+            std::lock_guard<std::mutex> lock(writer->mutex);
+            writer->pending[slot] = false;
+        }
+        writer->changed.notify_all();
+        slot = 1 - slot;
+    }
+}
+
+/*
+Input:
+    - writer: writer to start
+    - parameterFilename, geometryFilename, filename: see writeField
+    - parameter: to get parallelOutput
+Description:
+    Starts the writer thread on the processes that write results: process 0
+    if the field is gathered, every process if each one writes its piece.
+    The MPI-IO output is collective and stays synchronous.
+*/
+void startOutputWriter(OutputWriter &writer, std::string const &parameterFilename,
+                       std::string const &geometryFilename, std::string const &filename,
+                       Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    writer.parameterFilename = parameterFilename;
+    writer.geometryFilename = geometryFilename;
+    writer.filename = filename;
+    writer.pieces = (parameter->parallelOutput == pieceOutput) ? &subdomainInfo : NULL;
+    if (parameter->parallelOutput == mpiioOutput)
+        return;
+    if (writer.pieces != NULL || subdomainInfo.procID == 0)
+    {
+        writer.running = true;
+        writer.thread = std::thread(outputThread, &writer);
+    }
+}
+
+/*
+Input:
+    - writer: started writer
+    - localField: field of the process (the particles of the subdomain are written)
+    - globalField: field of process 0 (only its bounds are used)
+    - step: number of the time step, used in the file names
+    - currentTime: time of the field
+Description:
+    Copies the field to write in a free snapshot (gathered on process 0 or
+    particles of the subdomain) and queues it for the writer thread. Waits
+    only if both snapshots are still queued, i.e. if the writer is a full
+    output interval behind. Called by all the processes.
+*/
+void queueOutput(OutputWriter &writer, Field *localField, Field *globalField, int step, double currentTime,
+                 Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    int slot = writer.next;
+    if (writer.running)
+    {
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        writer.changed.wait(lock, [&writer, slot] { return !writer.pending[slot]; });
+    }
+    Field &snapshot = writer.snapshot[slot];
+
+    if (writer.pieces == NULL)
+    {
+        gatherOutput(&snapshot, localField, parameter, subdomainInfo);
+        if (!writer.running)
+            return;
+        for (int i = 0; i < 3; i++)
+        {
+            snapshot.l[i] = globalField->l[i];
+            snapshot.u[i] = globalField->u[i];
+        }
+    }
+    else
+    {
+        // Only the particles that pass the output filters are copied
+        int start = subdomainInfo.startingParticle;
+        int end = subdomainInfo.endingParticle + 1;
+        std::vector<int> selected;
+        snapshot.outputSelected = selectOutput(localField, start, end, parameter, selected);
+        if (!snapshot.outputSelected)
+        {
+            selected.resize(end - start);
+            for (int i = start; i < end; i++)
+                selected[i - start] = i;
+        }
+        sizeField(snapshot, selected.size());
+        for (unsigned int j = 0; j < selected.size(); j++)
+        {
+            int i = selected[j];
+            for (int coord = 0; coord < 3; coord++)
+            {
+                snapshot.pos[coord][j] = localField->pos[coord][i];
+                snapshot.speed[coord][j] = localField->speed[coord][i];
+            }
+            snapshot.density[j] = localField->density[i];
+            snapshot.pressure[j] = localField->pressure[i];
+            snapshot.mass[j] = localField->mass[i];
+            snapshot.type[j] = localField->type[i];
+        }
+        for (int coord = 0; coord < 3 && parameter->freeSurface == 2; coord++)
+        {
+            snapshot.normal[coord].resize(selected.size());
+            for (unsigned int j = 0; j < selected.size(); j++)
+                snapshot.normal[coord][j] = localField->normal[coord][selected[j]];
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            snapshot.l[i] = localField->l[i];
+            snapshot.u[i] = localField->u[i];
+        }
+    }
+    snapshot.currentTime = currentTime;
+    writer.parameter[slot] = *parameter;
+    writer.step[slot] = step;
+
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.pending[slot] = true;
+    }
+    writer.changed.notify_all();
+    writer.next = 1 - slot;
+}
+
+/* Waits until the snapshots queued are written (e.g. before a checkpoint, which counts them as done) */
+void flushOutputWriter(OutputWriter &writer)
+{
+    if (!writer.running)
+        return;
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    writer.changed.wait(lock, [&writer] { return !writer.pending[0] && !writer.pending[1]; });
+}
+
+/* Writes the snapshots still queued and stops the writer thread */
+void stopOutputWriter(OutputWriter &writer)
+{
+    if (!writer.running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.stop = true;
+    }
+    writer.changed.notify_all();
+    writer.thread.join();
+    writer.running = false;
+}
@@ -5,9 +5,18 @@
 #include <iomanip>
 #include <cstdio>
 #include <stdint.h>
+#include <algorithm>
+#include <set>
+#include <cstdlib>
+#include <mpi.h>
 #include "paraview.h"
 #include "swapbytes.h"
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifdef USE_ZLIB
 #include <zlib.h>
 #else
@@ -19,9 +28,11 @@ const bool isCpuLittleEndian = 1 == *(char *)(&__one__); // CPU endianness
 
 // this routine writes a vector of double as a vector of float to a legacy VTK file f.
 //  the vector is converted to float (32bits) and to "big endian" format (required by the legacy VTK format)
+//  the particles written are indices[i] (or i if indices is NULL) for i in [nbpStart, nbpEnd[
 
 void write_vectorLEGACY(std::ofstream &f,
-                        std::vector<double> const *pos, int dim, int nbpStart, int nbpEnd, bool binary)
+                        std::vector<double> const *pos, int dim, int nbpStart, int nbpEnd,
+                        std::vector<int> const *indices, bool binary)
 {
     /*std::cout << "write_vectorLEGACY";
     std::cout << "dim=" << dim << '\n';
@@ -31,8 +42,9 @@ void write_vectorLEGACY(std::ofstream &f,
     {
         for (int i = nbpStart; i < nbpEnd; ++i)
         {
+            int p = (indices == NULL) ? i : (*indices)[i];
             for (int j = 0; j < dim; ++j)
-                f << pos[j][i] << " ";
+                f << pos[j][p] << " ";
             f << '\n';
         }
     }
@@ -41,10 +53,11 @@ void write_vectorLEGACY(std::ofstream &f,
         if (isCpuLittleEndian)
             for (int i = nbpStart; i < nbpEnd; ++i)
             {
+                int p = (indices == NULL) ? i : (*indices)[i];
                 // float+little endian => double should be converted to float, then swapped
                 for (int j = 0; j < dim; ++j)
                 {
-                    float fx = (float)pos[j][i];
+                    float fx = (float)pos[j][p];
                     uint32_t x = swap_uint32(*(uint32_t *)&fx); // convert if CPU is little endian
                     f.write((char *)&x, sizeof(uint32_t));
                 }
@@ -57,7 +70,7 @@ void write_vectorLEGACY(std::ofstream &f,
             for (int i = nbpStart; i < nbpEnd; ++i)
                 for (int j = 0; j < 3; ++j)
                 {
-                    float fx = (float)pos[j][i];
+                    float fx = (float)pos[j][(indices == NULL) ? i : (*indices)[i]];
                     f.write((char *)&fx, sizeof(uint32_t));
                 }
         }
@@ -71,21 +84,29 @@ void write_vectorLEGACY(std::ofstream &f,
 //   step:    time step number
 //   scalars: scalar fields defined on particles (map linking [field name] <=> [vector of results v1, v2, v3, v4, ...]
 //   vectors: vector fields defined on particles (map linking [field name] <=> [vector of results v1x, v1y, v1z, v2x, v2y, ...]
+//   nbpStart, nbpEnd, indices: particles written (indices[i], or i if indices is NULL, for i in [nbpStart, nbpEnd[)
 //   binary:   'true' for binary format, 'false' for ASCII
+//   piece:   number of the piece (process) appended to the file name (-1 = whole field)
+//   returns false (reported) if the file could not be written
 
-void paraviewLEGACY(std::string const &filename,
+bool paraviewLEGACY(std::string const &filename,
                     int step,
                     std::vector<double> const (&pos)[3],
                     std::map<std::string, std::vector<double> *> const &scalars,
                     std::map<std::string, std::vector<double> (*)[3]> const &vectors,
                     int nbpStart, int nbpEnd,
-                    bool binary)
+                    std::vector<int> const *indices,
+                    bool binary,
+                    int piece)
 {
     int nbp = nbpEnd - nbpStart;
 
-    // build file name + stepno + vtk extension
+    // build file name + stepno (+ piece) + vtk extension
     std::stringstream s;
-    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step << ".vtk";
+    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step;
+    if (piece >= 0)
+        s << "_" << std::setw(4) << std::setfill('0') << piece;
+    s << ".vtk";
 
     // open file
     //std::cout << "writing results to " << s.str() << '\n';
@@ -99,14 +120,14 @@ void paraviewLEGACY(std::string const &filename,
 
     // points
     f << "POINTS " << nbp << " float\n";
-    write_vectorLEGACY(f, pos, 3, nbpStart, nbpEnd, binary);
+    write_vectorLEGACY(f, pos, 3, nbpStart, nbpEnd, indices, binary);
 
     // vertices
     f << "VERTICES " << nbp << " " << 2 * nbp << "\n";
     if (!binary)
     {
         for (int i = 0; i < nbp; ++i)
-            f << "1 " << i - nbpStart << '\n';
+            f << "1 " << i << '\n';
         f << '\n'; // empty line (required)
     }
     else
@@ -130,7 +151,7 @@ void paraviewLEGACY(std::string const &filename,
     {
         //assert(it->second->size()==nbp);
         f << it->first << " 1 " << nbp << " float\n";
-        write_vectorLEGACY(f, &*it->second, 1, nbpStart, nbpEnd, binary);
+        write_vectorLEGACY(f, &*it->second, 1, nbpStart, nbpEnd, indices, binary);
     }
 
     // vector fields
@@ -139,9 +160,16 @@ void paraviewLEGACY(std::string const &filename,
     {
         //assert(it->second->size()==3*nbp);
         f << itV->first << " 3 " << nbp << " float\n";
-        write_vectorLEGACY(f, &(*itV->second)[0], 3, nbpStart, nbpEnd, binary);
+        write_vectorLEGACY(f, &(*itV->second)[0], 3, nbpStart, nbpEnd, indices, binary);
     }
     f.close();
+    if (f.fail())
+    {
+        std::cout << "\nERROR: " << s.str() << " not written." << std::endl;
+        std::remove(s.str().c_str());
+        return false;
+    }
+    return true;
 }
 
 std::string zlibstatus(int status)
@@ -167,140 +195,295 @@ std::string zlibstatus(int status)
 #endif
 }
 
-size_t write_vectorXML(std::ofstream &f, std::vector<double> const *pos, int dim,
-                       int nbpStart, int nbpEnd, bool usez)
+// buffers reused from one array (and one frame) to the next, one set per writing thread
+struct XMLBuffers
+{
+    std::vector<float> values;          // array converted to float
+    std::vector<int> indices;           // connectivity and offsets of the verts
+    std::vector<char> packed;           // compressed blocks (one slot of compressBound(blockSize) per block)
+    std::vector<unsigned long> sizes;   // compressed size of each block
+    std::vector<char> shuffled;         // byte planes of the array (SHUFFLE filters)
+    std::vector<int> order;             // particles sorted by cell (SHUFFLE_DELTA filter)
+    std::vector<char> appended;         // appended data of the file
+    std::vector<char> aligned;          // whole file aligned for O_DIRECT
+};
+static thread_local XMLBuffers xmlBuffers;
+
+// stream buffer appending everything to a vector (whose capacity is kept from one file to the next)
+class AppendBuffer : public std::streambuf
 {
-    /*std::cout << "write_vectorXML\n";
-    std::cout << "dim="<<dim << '\n';
-    std::cout << "nbpStart="<<nbpStart << '\n';
-    std::cout << "nbpEnd="<<nbpEnd << '\n';*/
+    std::vector<char> &data;
 
-    size_t written = 0;
-    int nbp = nbpEnd - nbpStart;
+public:
+    AppendBuffer(std::vector<char> &d) : data(d) {}
 
-    if (!usez)
+protected:
+    std::streamsize xsputn(char const *s, std::streamsize n)
     {
-        // data block size
-        uint32_t sz = nbp * dim * sizeof(float);
-        f.write((char *)&sz, sizeof(uint32_t));
-        written += sizeof(uint32_t);
-        // data
-        for (int i = nbpStart; i < nbpEnd; ++i)
-        {
-            for (int j = 0; j < dim; ++j)
-            {
-                float fx = (float)pos[j][i];
-                f.write((char *)&fx, sizeof(float));
-            }
-        }
-        written += sz;
+        data.insert(data.end(), s, s + n);
+        return n;
     }
-    else
+    int_type overflow(int_type c)
     {
-        // convert double to float
-        std::vector<float> buffer(nbp * dim);
-        for (int i = nbpStart; i < nbpEnd; ++i)
-            for (int j = 0; j < dim; ++j)
-                buffer[(i - nbpStart) * dim + j] = (float)pos[j][i];
+        if (c != traits_type::eof())
+            data.push_back((char)c);
+        return c;
+    }
+};
 
-        size_t sourcelen = buffer.size() * sizeof(float);
-        size_t destlen = size_t(sourcelen * 1.001) + 12; // see doc
-        char *destbuffer = new char[destlen];
-#ifdef USE_ZLIB
-        int status = compress2((Bytef *)destbuffer, &destlen,
-                               (Bytef *)&(buffer[0]), sourcelen, Z_DEFAULT_COMPRESSION);
-#else
-        int status = Z_OK + 1;
-#endif
-        if (status != Z_OK)
-        {
-            std::cout << "ERROR: zlib Error status=" << zlibstatus(status) << "\n";
-        }
-        else
+// writes header + data + footer to the file name in one pass
+//   direct: bypasses the page cache with O_DIRECT (Linux only; falls back to a buffered write
+//           if the file system does not support it). The file is copied into an aligned buffer,
+//           whose aligned part is written directly and the remaining tail without O_DIRECT.
+//   sync:   the file is on disk when the function returns (fsync, Linux only)
+//   returns false if the file could not be written entirely
+
+bool writeFile(std::string const &name, std::string const &header, std::vector<char> const &data,
+               std::string const &footer, bool direct, bool sync)
+{
+#ifdef __linux__
+    if (direct)
+    {
+        const size_t alignment = 4096;
+        size_t size = header.size() + data.size() + footer.size();
+        std::vector<char> &aligned = xmlBuffers.aligned;
+        aligned.resize(size + 2 * alignment);
+        char *buffer = &aligned[0] + (alignment - (uintptr_t)&aligned[0] % alignment) % alignment;
+        std::copy(header.begin(), header.end(), buffer);
+        std::copy(data.begin(), data.end(), buffer + header.size());
+        std::copy(footer.begin(), footer.end(), buffer + header.size() + data.size());
+        size_t body = size - size % alignment;
+
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (fd >= 0)
         {
-            //std::cout << "block of size " << sourcelen << " compressed to " << destlen << '\n';
-            // blocks description
-            uint32_t nblocks = 1;
-            f.write((char *)&nblocks, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            uint32_t srclen = (uint32_t)sourcelen;
-            f.write((char *)&srclen, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            uint32_t lastblocklen = 0;
-            f.write((char *)&lastblocklen, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            uint32_t szblocki = (uint32_t)destlen;
-            f.write((char *)&szblocki, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            // data
-            f.write(destbuffer, destlen);
-            written += destlen;
+            bool ok = (body == 0) || write(fd, buffer, body) == (ssize_t)body;
+            ok = ok && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) == 0;
+            ok = ok && write(fd, buffer + body, size - body) == (ssize_t)(size - body);
+            ok = ok && (!sync || fsync(fd) == 0);
+            ok = (close(fd) == 0) && ok;
+            if (ok)
+                return true;
         }
-
-        delete[] destbuffer;
     }
+#endif
 
-    return written;
+    std::ofstream f(name.c_str(), std::ios::binary | std::ios::out);
+    f.write(header.data(), header.size());
+    f.write(data.data(), data.size());
+    f.write(footer.data(), footer.size());
+    f.close();
+    bool ok = !f.fail();
+#ifdef __linux__
+    if (ok && sync)
+    {
+        // the data written through the stream is flushed to the disk through another descriptor
+        int fd = open(name.c_str(), O_WRONLY);
+        ok = fd >= 0 && fsync(fd) == 0;
+        ok = (fd >= 0 && close(fd) == 0) && ok;
+    }
+#endif
+    return ok;
 }
 
-size_t write_vectorXML(std::ofstream &f, std::vector<int> const &pos, bool usez)
+// writes a block of bytes to the appended data of a XML file f:
+//   raw:        size (UInt32) + data
+//   compressed: blocks of compression.blockSize bytes compressed in parallel (OpenMP),
+//               with the multi-block header of vtkZLibDataCompressor
+//               [nblocks][blocksize][lastblocksize (0 if the last block is full)][compressed sizes...]
+
+size_t write_blockXML(std::ostream &f, char const *data, size_t sourcelen, bool usez,
+                      PCompression const &compression)
 {
-    //std::cout << "write_vectorXML(int)\n";
     size_t written = 0;
 
     if (!usez)
     {
         // data block size
-        uint32_t sz = pos.size() * sizeof(int);
+        uint32_t sz = (uint32_t)sourcelen;
         f.write((char *)&sz, sizeof(uint32_t));
         written += sizeof(uint32_t);
         // data
-        for (int i = 0; i < pos.size(); ++i)
+        f.write(data, sourcelen);
+        written += sourcelen;
+        return written;
+    }
+
+#ifdef USE_ZLIB
+    size_t blockSize = compression.blockSize;
+    int nblocks = std::max((int)((sourcelen + blockSize - 1) / blockSize), 1);
+    size_t slot = compressBound(blockSize);
+    std::vector<char> &packed = xmlBuffers.packed;
+    std::vector<unsigned long> &sizes = xmlBuffers.sizes;
+    if (packed.size() < nblocks * slot)
+        packed.resize(nblocks * slot);
+    sizes.resize(nblocks);
+
+    int status = Z_OK;
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < nblocks; ++b)
+    {
+        size_t start = b * blockSize;
+        size_t len = std::min(blockSize, sourcelen - start);
+        uLongf destlen = slot;
+        int blockStatus = compress2((Bytef *)&packed[b * slot], &destlen,
+                                    (Bytef const *)data + start, len, compression.level);
+        sizes[b] = destlen;
+        if (blockStatus != Z_OK)
         {
-            int fx = pos[i];
-            f.write((char *)&fx, sizeof(int));
+#pragma omp critical
+            status = blockStatus;
         }
-        written += sz;
     }
-    else
+    if (status != Z_OK)
     {
-        size_t sourcelen = pos.size() * sizeof(int);
-        size_t destlen = size_t(sourcelen * 1.001) + 12; // see doc
-        char *destbuffer = new char[destlen];
-#ifdef USE_ZLIB
-        int status = compress2((Bytef *)destbuffer, &destlen,
-                               (Bytef *)&(pos[0]), sourcelen, Z_DEFAULT_COMPRESSION);
+        std::cout << "ERROR: zlib Error status=" << zlibstatus(status) << "\n";
+        return written;
+    }
+
+    // blocks description
+    std::vector<uint32_t> header(3 + nblocks);
+    header[0] = nblocks;
+    header[1] = (uint32_t)((nblocks == 1) ? sourcelen : blockSize);
+    header[2] = (uint32_t)((nblocks == 1) ? 0 : sourcelen % blockSize);
+    for (int b = 0; b < nblocks; ++b)
+        header[3 + b] = (uint32_t)sizes[b];
+    f.write((char *)&header[0], header.size() * sizeof(uint32_t));
+    written += header.size() * sizeof(uint32_t);
+    // data
+    for (int b = 0; b < nblocks; ++b)
+    {
+        f.write(&packed[b * slot], sizes[b]);
+        written += sizes[b];
+    }
 #else
-        int status = Z_OK + 1;
+    std::cout << "ERROR: zlib Error status=" << zlibstatus(Z_OK + 1) << "\n";
 #endif
-        if (status != Z_OK)
-        {
-            std::cout << "ERROR: zlib Error status=" << zlibstatus(status) << "\n";
-        }
-        else
+
+    return written;
+}
+
+// byte planes of n 4-byte values: dst holds the first byte of all the values,
+// then the second byte, ... (the bytes of a plane are much alike, which helps zlib)
+
+void shuffleBytes(char const *src, char *dst, size_t n)
+{
+#pragma omp parallel for
+    for (long long i = 0; i < (long long)n; ++i)
+        for (int k = 0; k < 4; ++k)
+            dst[k * n + i] = src[i * 4 + k];
+}
+
+void unshuffleBytes(char const *src, char *dst, size_t n)
+{
+#pragma omp parallel for
+    for (long long i = 0; i < (long long)n; ++i)
+        for (int k = 0; k < 4; ++k)
+            dst[i * 4 + k] = src[k * n + i];
+}
+
+// delta coding of n values with dim interleaved components: each value is replaced by the
+// (zigzag coded) difference with the same component of the previous particle, so that the
+// high bytes of neighbouring particles become 0
+
+void deltaEncode(uint32_t *values, size_t n, int dim)
+{
+    for (size_t i = n; i-- > (size_t)dim;)
+    {
+        int32_t d = (int32_t)(values[i] - values[i - dim]);
+        values[i] = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+    }
+}
+
+void deltaDecode(uint32_t *values, size_t n, int dim)
+{
+    for (size_t i = dim; i < n; ++i)
+    {
+        uint32_t z = values[i];
+        values[i] = values[i - dim] + ((z >> 1) ^ (0u - (z & 1u)));
+    }
+}
+
+// order of the particles written (indices[i], or i if indices is NULL, for i in [nbpStart, nbpEnd[)
+// sorted by cell of size cellSize (unsorted if cellSize <= 0)
+
+void cellOrder(std::vector<double> const (&pos)[3], int nbpStart, int nbpEnd,
+               std::vector<int> const *indices, double cellSize, std::vector<int> &order)
+{
+    int nbp = nbpEnd - nbpStart;
+    order.resize(nbp);
+    for (int i = 0; i < nbp; ++i)
+        order[i] = (indices == NULL) ? nbpStart + i : (*indices)[nbpStart + i];
+    if (cellSize <= 0.0 || nbp == 0)
+        return;
+
+    double l[3] = {pos[0][order[0]], pos[1][order[0]], pos[2][order[0]]};
+    double u[3] = {l[0], l[1], l[2]};
+    for (int i = 1; i < nbp; ++i)
+        for (int j = 0; j < 3; ++j)
         {
-            // blocks description
-            uint32_t nblocks = 1;
-            f.write((char *)&nblocks, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            uint32_t srclen = (uint32_t)sourcelen;
-            f.write((char *)&srclen, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            uint32_t lastblocklen = 0;
-            f.write((char *)&lastblocklen, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            uint32_t szblocki = (uint32_t)destlen;
-            f.write((char *)&szblocki, sizeof(uint32_t));
-            written += sizeof(uint32_t);
-            // data
-            f.write(destbuffer, destlen);
-            written += destlen;
+            l[j] = std::min(l[j], pos[j][order[i]]);
+            u[j] = std::max(u[j], pos[j][order[i]]);
         }
+    long long nx = (long long)((u[0] - l[0]) / cellSize) + 1;
+    long long ny = (long long)((u[1] - l[1]) / cellSize) + 1;
 
-        delete[] destbuffer;
+    std::vector<std::pair<long long, int>> cell(nbp);
+    for (int i = 0; i < nbp; ++i)
+    {
+        int p = order[i];
+        cell[i].first = ((long long)((pos[2][p] - l[2]) / cellSize) * ny + (long long)((pos[1][p] - l[1]) / cellSize)) * nx + (long long)((pos[0][p] - l[0]) / cellSize);
+        cell[i].second = p;
     }
+    std::stable_sort(cell.begin(), cell.end(),
+                     [](std::pair<long long, int> const &a, std::pair<long long, int> const &b) { return a.first < b.first; });
+    for (int i = 0; i < nbp; ++i)
+        order[i] = cell[i].second;
+}
 
-    return written;
+// writes n 4-byte values (dim components per particle) through the pre-compression filter
+// (only with zlib); the values are modified by the delta coding (positions only)
+
+size_t write_filteredXML(std::ostream &f, uint32_t *values, size_t n, int dim, bool delta,
+                         bool usez, PCompression const &compression)
+{
+    if (!usez || compression.filter == NO_FILTER)
+        return write_blockXML(f, (char const *)values, n * sizeof(uint32_t), usez, compression);
+
+    if (delta && compression.filter == SHUFFLE_DELTA)
+        deltaEncode(values, n, dim);
+    std::vector<char> &shuffled = xmlBuffers.shuffled;
+    shuffled.resize(n * sizeof(uint32_t));
+    shuffleBytes((char const *)values, shuffled.data(), n);
+    return write_blockXML(f, shuffled.data(), shuffled.size(), usez, compression);
+}
+
+// order: particles to write, order[0] to order[nbpEnd - nbpStart - 1] (NULL = [nbpStart, nbpEnd[)
+// delta: positions (delta coded by the SHUFFLE_DELTA filter)
+
+size_t write_vectorXML(std::ostream &f, std::vector<double> const *pos, int dim,
+                       int nbpStart, int nbpEnd, bool usez, PCompression const &compression,
+                       int const *order = NULL, bool delta = false)
+{
+    int nbp = nbpEnd - nbpStart;
+
+    // convert double to float
+    std::vector<float> &buffer = xmlBuffers.values;
+    buffer.resize(nbp * dim);
+#pragma omp parallel for
+    for (int i = 0; i < nbp; ++i)
+    {
+        int p = (order == NULL) ? nbpStart + i : order[i];
+        for (int j = 0; j < dim; ++j)
+            buffer[i * dim + j] = (float)pos[j][p];
+    }
+
+    return write_filteredXML(f, (uint32_t *)buffer.data(), buffer.size(), dim, delta, usez, compression);
+}
+
+size_t write_vectorXML(std::ostream &f, std::vector<int> &pos, bool usez, PCompression const &compression)
+{
+    return write_filteredXML(f, (uint32_t *)pos.data(), pos.size(), 1, false, usez, compression);
 }
 
 // export results to paraview (VTK polydata - XML fomat)
@@ -309,17 +492,25 @@ size_t write_vectorXML(std::ofstream &f, std::vector<int> const &pos, bool usez)
 //   step:    time step number
 //   scalars: scalar fields defined on particles (map linking [field name] <=> [vector of results v1, v2, v3, v4, ...]
 //   vectors: vector fields defined on particles (map linking [field name] <=> [vector of results v1x, v1y, v1z, v2x, v2y, ...]
+//   nbpStart, nbpEnd, indices: particles written (indices[i], or i if indices is NULL, for i in [nbpStart, nbpEnd[)
+//   piece:   number of the piece (process) appended to the file name (-1 = whole field)
+//   direct:  'true' to bypass the page cache (O_DIRECT, see writeFile)
+//   returns false (reported) if the file could not be written
 
 // see http://www.vtk.org/Wiki/VTK_XML_Formats
 
-void paraviewXML(std::string const &filename,
+bool paraviewXML(std::string const &filename,
                  int step,
                  std::vector<double> const (&pos)[3],
                  std::map<std::string, std::vector<double> *> const &scalars,
                  std::map<std::string, std::vector<double> (*)[3]> const &vectors,
                  int nbpStart, int nbpEnd,
+                 std::vector<int> const *indices,
                  bool binary,
-                 bool usez)
+                 bool usez,
+                 int piece,
+                 PCompression const &compression,
+                 bool direct)
 {
 #if !defined(USE_ZLIB)
     if (binary && usez)
@@ -333,16 +524,30 @@ void paraviewXML(std::string const &filename,
 
     // build file name + stepno + vtk extension
     std::stringstream s;
-    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step << ".vtp";
-    std::stringstream s2;
-    s2 << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step << ".vtp.tmp";
-
-    // open file
-    //std::cout << "writing results to " << s.str() << '\n';
-    std::ofstream f(s.str().c_str(), std::ios::binary | std::ios::out);
-    std::ofstream f2(s2.str().c_str(), std::ios::binary | std::ios::out); // temp binary file
+    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step;
+    if (piece >= 0)
+        s << "_" << std::setw(4) << std::setfill('0') << piece;
+    s << ".vtp";
+
+    // the header (f) and the appended data (f2) are built in memory: the offsets of the
+    // arrays are only known once they are compressed, and the file is then written in one pass
+    std::ostringstream f;
+    xmlBuffers.appended.clear();
+    AppendBuffer appendBuffer(xmlBuffers.appended);
+    std::ostream f2(&appendBuffer);
     f << std::scientific;
 
+    // pre-compression filter (zlib only), given in an attribute of the arrays for vtpfilter
+    PFilter filter = usez ? compression.filter : NO_FILTER;
+    int const *order = (indices == NULL) ? NULL : indices->data() + nbpStart;
+    if (filter == SHUFFLE_DELTA)
+    {
+        cellOrder(pos, nbpStart, nbpEnd, indices, compression.cellSize, xmlBuffers.order);
+        order = xmlBuffers.order.data();
+    }
+    std::string filterAttr = (filter == NO_FILTER) ? "" : " filter=\"shuffle\" ";
+    std::string pointsAttr = (filter == SHUFFLE_DELTA) ? " filter=\"delta+shuffle\" " : filterAttr;
+
     size_t offset = 0;
     // header
     f << "<VTKFile type=\"PolyData\" version=\"0.1\" byte_order=\"";
@@ -370,8 +575,8 @@ void paraviewXML(std::string const &filename,
         f << " format=\"appended\" ";
         f << " RangeMin=\"0\" ";
         f << " RangeMax=\"1\" ";
-        f << " offset=\"" << offset << "\" />\n";
-        offset += write_vectorXML(f2, &*it->second, 1, nbpStart, nbpEnd, usez);
+        f << filterAttr << " offset=\"" << offset << "\" />\n";
+        offset += write_vectorXML(f2, &*it->second, 1, nbpStart, nbpEnd, usez, compression, order);
     }
     // vector fields
     std::map<std::string, std::vector<double>(*)[3]>::const_iterator itV = vectors.begin();
@@ -384,8 +589,8 @@ void paraviewXML(std::string const &filename,
         f << " format=\"appended\" ";
         f << " RangeMin=\"0\" ";
         f << " RangeMax=\"1\" ";
-        f << " offset=\"" << offset << "\" />\n";
-        offset += write_vectorXML(f2, &(*itV->second)[0], 3, nbpStart, nbpEnd, usez);
+        f << filterAttr << " offset=\"" << offset << "\" />\n";
+        offset += write_vectorXML(f2, &(*itV->second)[0], 3, nbpStart, nbpEnd, usez, compression, order);
     }
     f << "      </PointData>\n";
 
@@ -401,8 +606,8 @@ void paraviewXML(std::string const &filename,
     f << " format=\"appended\" ";
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
-    f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, pos, 3, nbpStart, nbpEnd, usez);
+    f << pointsAttr << " offset=\"" << offset << "\" />\n";
+    offset += write_vectorXML(f2, pos, 3, nbpStart, nbpEnd, usez, compression, order, true);
     f << "      </Points>\n";
     // ------------------------------------------------------------------------------------
     f << "      <Verts>\n";
@@ -411,24 +616,25 @@ void paraviewXML(std::string const &filename,
     f << " format=\"appended\" ";
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"" << nbp - 1 << "\" ";
-    f << " offset=\"" << offset << "\" />\n";
+    f << filterAttr << " offset=\"" << offset << "\" />\n";
 
-    std::vector<int> connectivity(nbp); // <= hard to avoid if zlib is used
+    std::vector<int> &connectivity = xmlBuffers.indices; // <= hard to avoid if zlib is used
+    connectivity.resize(nbp);
     for (int i = 0; i < nbp; ++i)
         connectivity[i] = i;
-    offset += write_vectorXML(f2, connectivity, usez);
+    offset += write_vectorXML(f2, connectivity, usez, compression);
 
     f << "        <DataArray type=\"Int32\" ";
     f << " Name=\"offsets\" ";
     f << " format=\"appended\" ";
     f << " RangeMin=\"1\" ";
     f << " RangeMax=\"" << nbp << "\" ";
-    f << " offset=\"" << offset << "\" />\n";
+    f << filterAttr << " offset=\"" << offset << "\" />\n";
 
     // reuse "connectivity" for offsets
     for (int i = 0; i < nbp; ++i)
         connectivity[i] = i + 1;
-    offset += write_vectorXML(f2, connectivity, usez);
+    offset += write_vectorXML(f2, connectivity, usez, compression);
 
     f << "      </Verts>\n";
 
@@ -441,7 +647,7 @@ void paraviewXML(std::string const &filename,
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
     f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez);
+    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez, compression);
 
     f << "        <DataArray type=\"Int32\" ";
     f << " Name=\"offsets\" ";
@@ -449,7 +655,7 @@ void paraviewXML(std::string const &filename,
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
     f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez);
+    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez, compression);
     f << "      </Lines>\n";
 
     // ------------------------------------------------------------------------------------
@@ -460,14 +666,14 @@ void paraviewXML(std::string const &filename,
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
     f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez);
+    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez, compression);
     f << "        <DataArray type=\"Int32\" ";
     f << " Name=\"offsets\" ";
     f << " format=\"appended\" ";
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
     f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez);
+    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez, compression);
     f << "      </Strips>\n";
 
     // ------------------------------------------------------------------------------------
@@ -478,18 +684,16 @@ void paraviewXML(std::string const &filename,
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
     f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez);
+    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez, compression);
     f << "        <DataArray type=\"Int32\" ";
     f << " Name=\"offsets\" ";
     f << " format=\"appended\" ";
     f << " RangeMin=\"0\" ";
     f << " RangeMax=\"1\" ";
     f << " offset=\"" << offset << "\" />\n";
-    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez);
+    offset += write_vectorXML(f2, &empty, 1, 0, 0, usez, compression);
     f << "      </Polys>\n";
 
-    f2.close();
-
     // ------------------------------------------------------------------------------------
     f << "    </Piece>\n";
     f << "  </PolyData>\n";
@@ -497,43 +701,319 @@ void paraviewXML(std::string const &filename,
     f << "  <AppendedData encoding=\"raw\">\n";
     f << "    _";
 
-    // copy temp binary file
-    std::ifstream f3(s2.str().c_str(), std::ios::binary | std::ios::in);
-    f << f3.rdbuf();
-    f3.close();
-    // remove temp file
-    std::remove(s2.str().c_str());
+    //std::cout << "writing results to " << s.str() << '\n';
+    if (!writeFile(s.str(), f.str(), xmlBuffers.appended, "  </AppendedData>\n</VTKFile>\n", direct))
+    {
+        std::cout << "\nERROR: " << s.str() << " not written." << std::endl;
+        std::remove(s.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+// index of the pieces written by each process (VTK parallel polydata - XML format)
+//   filename: file name without vtk extension (same as the pieces)
+//   pieces:   numbers of the pieces written (processes)
+//   scalars/vectors: fields of the pieces (only their names are used)
+//   returns false (reported) if the index could not be written
+
+bool paraviewIndex(std::string const &filename,
+                   int step, std::vector<int> const &pieces,
+                   std::map<std::string, std::vector<double> *> const &scalars,
+                   std::map<std::string, std::vector<double> (*)[3]> const &vectors)
+{
+    std::stringstream name;
+    name << filename << "_" << std::setw(8) << std::setfill('0') << step;
+    std::ofstream f(("Results/" + name.str() + ".pvtp").c_str());
+
+    f << "<VTKFile type=\"PPolyData\" version=\"0.1\" byte_order=\"";
+    f << (isCpuLittleEndian ? "LittleEndian" : "BigEndian") << "\">\n";
+    f << "  <PPolyData GhostLevel=\"0\">\n";
+    f << "    <PPointData>\n";
+    std::map<std::string, std::vector<double> *>::const_iterator it = scalars.begin();
+    for (; it != scalars.end(); ++it)
+        f << "      <PDataArray type=\"Float32\" Name=\"" << it->first << "\" />\n";
+    std::map<std::string, std::vector<double>(*)[3]>::const_iterator itV = vectors.begin();
+    for (; itV != vectors.end(); ++itV)
+        f << "      <PDataArray type=\"Float32\" Name=\"" << itV->first << "\" NumberOfComponents=\"3\" />\n";
+    f << "    </PPointData>\n";
+    f << "    <PPoints>\n";
+    f << "      <PDataArray type=\"Float32\" Name=\"Points\" NumberOfComponents=\"3\" />\n";
+    f << "    </PPoints>\n";
+    // pieces are in the same directory as the index
+    for (unsigned int p = 0; p < pieces.size(); ++p)
+        f << "    <Piece Source=\"" << name.str() << "_" << std::setw(4) << std::setfill('0') << pieces[p] << ".vtp\" />\n";
+    f << "  </PPolyData>\n";
+    f << "</VTKFile>\n";
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "\nERROR: Results/" << name.str() << ".pvtp not written." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// index of the datasets of a step (VTK multiblock - XML format), e.g. the particles of the
+// step and the boundary written once
+//   filename: file name without vtm extension
+//   names:    names of the blocks
+//   files:    files of the blocks (in the same directory as the index)
 
-    f << "  </AppendedData>\n";
+void paraviewMultiBlock(std::string const &filename,
+                        int step,
+                        std::vector<std::string> const &names,
+                        std::vector<std::string> const &files)
+{
+    std::stringstream s;
+    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step << ".vtm";
+    std::ofstream f(s.str().c_str());
+
+    f << "<VTKFile type=\"vtkMultiBlockDataSet\" version=\"1.0\" byte_order=\"";
+    f << (isCpuLittleEndian ? "LittleEndian" : "BigEndian") << "\">\n";
+    f << "  <vtkMultiBlockDataSet>\n";
+    for (size_t b = 0; b < files.size(); ++b)
+        f << "    <DataSet index=\"" << b << "\" name=\"" << names[b] << "\" file=\"" << files[b] << "\" />\n";
+    f << "  </vtkMultiBlockDataSet>\n";
     f << "</VTKFile>\n";
+    f.close();
+}
 
+// time series of the files of a dataset (ParaView collection - XML format), updated at each step
+//   filename: file name without pvd extension
+//   file:     file of the step (in the same directory as the collection)
+//   time:     physical time of the step
+//   create:   'true' to start a new collection (otherwise the step is added at the end)
+//   a new run creates its collections at step 0; only a run that did not (restart from a
+//   checkpoint) continues an existing collection, whose steps that are not before its first
+//   step are removed
+
+void paraviewCollection(std::string const &filename,
+                        std::string const &file,
+                        double time,
+                        bool create)
+{
+    static std::set<std::string> continued; // collections created or continued by this run
+
+    std::string name = "Results/" + filename + ".pvd";
+    std::string footer = "  </Collection>\n</VTKFile>\n";
+    std::stringstream entry;
+    entry << std::setprecision(12);
+    entry << "    <DataSet timestep=\"" << time << "\" group=\"\" part=\"0\" file=\"" << file << "\" />\n";
+
+    // the new step overwrites the end of the collection
+    std::fstream f;
+    bool started = continued.insert(filename).second;
+    if (!create && started)
+    {
+        std::ifstream previous(name.c_str());
+        std::string kept, line;
+        while (std::getline(previous, line) && line != "  </Collection>")
+        {
+            size_t at = line.find("timestep=\"");
+            if (at != std::string::npos && atof(line.c_str() + at + 10) >= time * (1.0 - 1.0e-9))
+                break;
+            kept += line + "\n";
+        }
+        previous.close();
+        if (!kept.empty())
+        {
+            f.open(name.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+            f << kept << entry.str() << footer;
+            return;
+        }
+    }
+    else if (!create)
+        f.open(name.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+    if (f.is_open())
+    {
+        f.seekp(0, std::ios::end);
+        f.seekp((std::streamoff)f.tellp() - (std::streamoff)footer.size());
+    }
+    else
+    {
+        f.open(name.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+        f << "<VTKFile type=\"Collection\" version=\"0.1\" byte_order=\"";
+        f << (isCpuLittleEndian ? "LittleEndian" : "BigEndian") << "\">\n";
+        f << "  <Collection>\n";
+    }
+    f << entry.str() << footer;
     f.close();
 }
 
-// interface
+// export results of all the processes to a single paraview file (VTK polydata - XML format) with MPI-IO
+//   each process writes its particles (indices[i], or i if indices is NULL, for i in [nbpStart, nbpEnd[)
+//   at their place in the appended data
+//   (uncompressed: the size of a compressed block is only known once it is compressed)
+//   collective: must be called by all the processes
+//   returns false (on every process, reported by process 0) if the file could not be written
+
+bool paraviewMPIIO(std::string const &filename,
+                   int step,
+                   std::vector<double> const (&pos)[3],
+                   std::map<std::string, std::vector<double> *> const &scalars,
+                   std::map<std::string, std::vector<double> (*)[3]> const &vectors,
+                   int nbpStart, int nbpEnd,
+                   std::vector<int> const *indices)
+{
+    int procID;
+    MPI_Comm_rank(MPI_COMM_WORLD, &procID);
+
+    // particles of the previous processes and of all the processes
+    long long nbp = nbpEnd - nbpStart;
+    long long first = 0, nbpGlobal;
+    MPI_Exscan(&nbp, &first, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (procID == 0)
+        first = 0;
+    MPI_Allreduce(&nbp, &nbpGlobal, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    // arrays of the appended data (in this order): name, values (NULL for the verts) and components
+    std::vector<std::string> names;
+    std::vector<std::vector<double> const *> values;
+    std::vector<int> dims;
+    std::map<std::string, std::vector<double> *>::const_iterator it = scalars.begin();
+    for (; it != scalars.end(); ++it)
+    {
+        names.push_back(it->first);
+        values.push_back(&*it->second);
+        dims.push_back(1);
+    }
+    std::map<std::string, std::vector<double>(*)[3]>::const_iterator itV = vectors.begin();
+    for (; itV != vectors.end(); ++itV)
+    {
+        names.push_back(itV->first);
+        values.push_back(&(*itV->second)[0]);
+        dims.push_back(3);
+    }
+    names.push_back("Points");
+    values.push_back(pos);
+    dims.push_back(3);
+    names.push_back("connectivity");
+    values.push_back(NULL);
+    dims.push_back(1);
+    names.push_back("offsets");
+    values.push_back(NULL);
+    dims.push_back(1);
+    int nArrays = names.size();
+
+    // block of each array: size (UInt64) then 4-byte values of all the processes
+    std::vector<long long> offsets(nArrays + 1, 0);
+    for (int a = 0; a < nArrays; ++a)
+        offsets[a + 1] = offsets[a] + sizeof(uint64_t) + nbpGlobal * dims[a] * 4;
+
+    // header (identical on all the processes, written by process 0)
+    std::stringstream h;
+    h << "<VTKFile type=\"PolyData\" version=\"0.1\" byte_order=\"";
+    h << (isCpuLittleEndian ? "LittleEndian" : "BigEndian") << "\" ";
+    h << "header_type=\"UInt64\">\n";
+    h << "  <PolyData>\n";
+    h << "    <Piece NumberOfPoints=\"" << nbpGlobal << "\" NumberOfVerts=\"" << nbpGlobal << "\" ";
+    h << "NumberOfLines=\"0\" NumberOfStrips=\"0\" NumberOfPolys=\"0\">\n";
+    for (int a = 0; a < nArrays; ++a)
+    {
+        if (a == 0)
+            h << "      <PointData>\n";
+        if (names[a] == "Points")
+            h << "      </PointData>\n      <Points>\n";
+        if (names[a] == "connectivity")
+            h << "      </Points>\n      <Verts>\n";
+        h << "        <DataArray type=\"" << ((values[a] == NULL) ? "Int32" : "Float32") << "\" ";
+        h << " Name=\"" << names[a] << "\" ";
+        if (dims[a] == 3)
+            h << " NumberOfComponents=\"3\" ";
+        h << " format=\"appended\" ";
+        h << " offset=\"" << offsets[a] << "\" />\n";
+    }
+    h << "      </Verts>\n";
+    h << "    </Piece>\n";
+    h << "  </PolyData>\n";
+    h << "  <AppendedData encoding=\"raw\">\n";
+    h << "    _";
+    std::string header = h.str();
+    std::string footer = "\n  </AppendedData>\n</VTKFile>\n";
+    MPI_Offset base = header.size();
+
+    // build file name + stepno + vtk extension
+    std::stringstream s;
+    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step << ".vtp";
+    MPI_File fh;
+    int opened = MPI_File_open(MPI_COMM_WORLD, (char *)s.str().c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                               MPI_INFO_NULL, &fh) == MPI_SUCCESS;
+    int ok = opened;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        if (opened)
+            MPI_File_close(&fh);
+        if (procID == 0)
+            std::cout << "\nERROR: " << s.str() << " not written (MPI_File_open failed)." << std::endl;
+        return false;
+    }
+    ok = MPI_File_set_size(fh, 0) == MPI_SUCCESS;
+
+    if (procID == 0)
+    {
+        ok = ok && MPI_File_write_at(fh, 0, (void *)header.c_str(), header.size(), MPI_CHAR, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+        for (int a = 0; a < nArrays; ++a)
+        {
+            uint64_t sz = nbpGlobal * dims[a] * 4;
+            ok = ok && MPI_File_write_at(fh, base + offsets[a], &sz, sizeof(uint64_t), MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+        }
+        ok = ok && MPI_File_write_at(fh, base + offsets[nArrays], (void *)footer.c_str(), footer.size(), MPI_CHAR, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+    }
+
+    // values of this process (double converted to float, global indices for the verts)
+    std::vector<float> buffer(nbp * 3);
+    std::vector<int32_t> verts(nbp);
+    for (int a = 0; a < nArrays; ++a)
+    {
+        MPI_Offset at = base + offsets[a] + sizeof(uint64_t) + first * dims[a] * 4;
+        if (values[a] != NULL)
+        {
+            for (int i = nbpStart; i < nbpEnd; ++i)
+                for (int j = 0; j < dims[a]; ++j)
+                    buffer[(i - nbpStart) * dims[a] + j] = (float)values[a][j][(indices == NULL) ? i : (*indices)[i]];
+            if (MPI_File_write_at_all(fh, at, buffer.data(), nbp * dims[a], MPI_FLOAT, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+                ok = 0;
+        }
+        else
+        {
+            int shift = (names[a] == "offsets") ? 1 : 0;
+            for (int i = 0; i < nbp; ++i)
+                verts[i] = (int32_t)(first + i + shift);
+            if (MPI_File_write_at_all(fh, at, verts.data(), nbp, MPI_INT, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+                ok = 0;
+        }
+    }
+    if (MPI_File_close(&fh) != MPI_SUCCESS)
+        ok = 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok && procID == 0)
+        std::cout << "\nERROR: " << s.str() << " not written." << std::endl;
+    return ok != 0;
+}
+
+// interface (returns false if the file could not be written)
 
-void paraview(std::string const &filename,
+bool paraview(std::string const &filename,
               int step,
               std::vector<double> const (&pos)[3],
               std::map<std::string, std::vector<double> *> const &scalars,
               std::map<std::string, std::vector<double> (*)[3]> const &vectors,
               int nbpStart, int nbpEnd,
-              PFormat format)
+              std::vector<int> const *indices,
+              PFormat format, int piece, PCompression const &compression, bool direct)
 {
     switch (format)
     {
     case LEGACY_TXT:
-        paraviewLEGACY(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, false);
-        break;
+        return paraviewLEGACY(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, indices, false, piece);
     case XML_BIN:
-        paraviewXML(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, true, false);
-        break;
+        return paraviewXML(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, indices, true, false, piece, compression, direct);
     case XML_BINZ:
-        paraviewXML(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, true, true);
-        break;
+        return paraviewXML(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, indices, true, true, piece, compression, direct);
     case LEGACY_BIN:
     default:
-        paraviewLEGACY(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, true);
-        break;
+        return paraviewLEGACY(filename, step, pos, scalars, vectors, nbpStart, nbpEnd, indices, true, piece);
     }
 }
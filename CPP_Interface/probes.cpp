@@ -0,0 +1,230 @@
+///**************************************************************************
+/// SOURCE: Probes and wave gauges (#probe): time series of the field interpolated at given positions.
+///**************************************************************************
+#include "Main.h"
+#include "Interface.h"
+#include "Physics.h"
+
+#define PROBE_SUMS 6         // volume, density, pressure, velocity X, Y, Z
+#define PROBE_FLUSH_ROWS 100 // rows of the series kept in the buffer of the file at most
+
+/*
+Input:
+    - writer: the probes to set up
+    - filename: name of the experiment (the series is Results/<filename>_probes.txt)
+    - parameterFilename: name of the parameter file (header of the series)
+    - parameter: probes and probeInterval of the "#probe" section
+    - subdomainInfo: process 0 opens the series
+    - restartTime: time of the checkpoint of a restart (negative for a new series)
+Description:
+    Numbers the sampled positions of the probes and writes the header of the
+    series. On a restart, the series is continued: the rows written after the
+    checkpoint by the interrupted run are removed. The header (lines starting with %) gives the probes, their
+    positions and the columns: the time, then density, pressure, velocityX,
+    velocityY and velocityZ at each position of the point, line and plane
+    probes, then the free surface elevation of each gauge.
+*/
+void startProbes(ProbeWriter &writer, std::string const &filename, std::string const &parameterFilename,
+                 Parameter *parameter, SubdomainInfo &subdomainInfo, double restartTime)
+{
+    const char *typeNames[4] = {"point", "line", "plane", "gauge"};
+    std::vector<Probe> &probes = parameter->probes;
+
+    writer.probeStart.assign(1, 0);
+    for (unsigned int p = 0; p < probes.size(); p++)
+        writer.probeStart.push_back(writer.probeStart.back() + probes[p].pos[0].size());
+    writer.sums.assign(PROBE_SUMS * writer.probeStart.back(), 0.0);
+    if (probes.empty() || subdomainInfo.procID != 0)
+        return;
+
+    std::string name = "Results/" + filename + "_probes.txt";
+    if (restartTime >= 0.0)
+    {
+        std::ifstream previous(name.c_str());
+        std::string kept, line;
+        while (std::getline(previous, line) && (line[0] == '%' || atof(line.c_str()) <= restartTime + 0.5 * parameter->k))
+            kept += line + "\n";
+        previous.close();
+        if (!kept.empty())
+        {
+            writer.file.open(name.c_str());
+            writer.file << kept;
+            return;
+        }
+    }
+
+    writer.file.open(name.c_str());
+    std::ofstream &f = writer.file;
+    f << "% PROBES: " << filename << " (" << parameterFilename << "), sampled every "
+      << parameter->probeInterval << " time step(s)\n";
+    f << "% columns: time, then density pressure velocityX velocityY velocityZ at each position"
+      << " of the point, line and plane probes, then the elevation of each gauge\n";
+    f << std::scientific;
+    int column = 2;
+    for (unsigned int p = 0; p < probes.size(); p++)
+    {
+        int n = probes[p].pos[0].size();
+        f << "% probe " << p + 1 << ": " << typeNames[probes[p].type] << ", " << n << " position(s)";
+        if (probes[p].type != gaugeProbe)
+        {
+            f << ", columns " << column << " to " << column + 5 * n - 1 << "\n";
+            column += 5 * n;
+            for (int a = 0; a < n; a++)
+                f << "%   " << probes[p].pos[0][a] << " " << probes[p].pos[1][a] << " " << probes[p].pos[2][a] << "\n";
+        }
+        else
+            f << " from " << probes[p].pos[2][0] << " to " << probes[p].pos[2][n - 1] << " at ("
+              << probes[p].pos[0][0] << ", " << probes[p].pos[1][0] << ")\n";
+    }
+    for (unsigned int p = 0; p < probes.size(); p++)
+        if (probes[p].type == gaugeProbe)
+            f << "% gauge (probe " << p + 1 << "): column " << column++ << "\n";
+}
+
+/*
+Input:
+    - probe: a gauge
+    - sums: sums of the positions of the gauge
+Output:
+    - the height at which the volume sum of the free particles (about 1 in the
+      fluid, 0 out of it) crosses 0.5, searched from the top of the gauge
+      (the bottom of the gauge if it is dry)
+*/
+static double gaugeElevation(Probe const &probe, double const *sums)
+{
+    std::vector<double> const &z = probe.pos[2];
+    for (int a = z.size() - 1; a >= 0; a--)
+    {
+        double volume = sums[PROBE_SUMS * a];
+        if (volume >= 0.5)
+        {
+            if (a == (int)z.size() - 1)
+                return z[a];
+            double above = sums[PROBE_SUMS * (a + 1)];
+            return z[a] + (0.5 - volume) / (above - volume) * (z[a + 1] - z[a]);
+        }
+    }
+    return z[0];
+}
+
+/*
+Input:
+    - writer: probes set up by startProbes
+    - field: local field of the process (halos included, up to date)
+    - currentTime: time of the sample
+    - parameter: pointer to the structure containing the user defined parameters
+    - subdomainInfo: the process owning a position computes its values
+    - boxes, surrBoxesAll: box mesh of the local field (the boxes are filled here)
+Description:
+    Interpolates the free particles at each position owned by the process
+    (Shepard normalized SPH sums over the particles of the surrounding boxes,
+    halos included) and appends a row to the series on process 0. The series is
+    flushed every PROBE_FLUSH_ROWS rows (and by flushProbes).
+*/
+void sampleProbes(ProbeWriter &writer, Field *field, double currentTime, Parameter *parameter,
+                  SubdomainInfo &subdomainInfo, std::vector<std::vector<int>> &boxes,
+                  std::vector<std::vector<int>> &surrBoxesAll)
+{
+    std::vector<Probe> &probes = parameter->probes;
+    if (probes.empty())
+        return;
+    int nPositions = writer.probeStart.back();
+    double boxSize = subdomainInfo.boxSize;
+
+    // Positions of the process
+    std::vector<std::pair<int, int>> owned; // probe, position
+    for (unsigned int p = 0; p < probes.size(); p++)
+        for (unsigned int a = 0; a < probes[p].pos[0].size(); a++)
+        {
+            double pos[3] = {probes[p].pos[0][a], probes[p].pos[1][a], probes[p].pos[2][a]};
+            int box[3];
+            positionBox(pos, subdomainInfo, box);
+            if (getDomainNumber(box, subdomainInfo) == subdomainInfo.procID)
+                owned.push_back(std::make_pair(p, a));
+        }
+
+    std::fill(writer.sums.begin(), writer.sums.end(), 0.0);
+    if (!owned.empty())
+    {
+        sortParticles(field->pos, field->l, field->u, boxSize, boxes);
+        int nBoxes[3];
+        for (int i = 0; i < 3; i++)
+            nBoxes[i] = ceil((field->u[i] - field->l[i]) / boxSize);
+
+#pragma omp parallel for schedule(dynamic)
+        for (unsigned int o = 0; o < owned.size(); o++)
+        {
+            Probe &probe = probes[owned[o].first];
+            int a = owned[o].second;
+            double pos[3] = {probe.pos[0][a], probe.pos[1][a], probe.pos[2][a]};
+            double *sums = &writer.sums[PROBE_SUMS * (writer.probeStart[owned[o].first] + a)];
+
+            // Box of the local mesh containing the position
+            int box[3];
+            for (int i = 0; i < 3; i++)
+            {
+                double temp = (pos[i] - field->l[i]) / boxSize;
+                box[i] = (temp < 0) ? 0 : ((temp < nBoxes[i] - 1) ? (int)temp : nBoxes[i] - 1);
+            }
+            std::vector<int> &surrBoxes = surrBoxesAll[box[2] + box[1] * nBoxes[2] + box[0] * nBoxes[2] * nBoxes[1]];
+
+            for (unsigned int b = 0; b < surrBoxes.size(); b++)
+                for (unsigned int j = 0; j < boxes[surrBoxes[b]].size(); j++)
+                {
+                    int particleID = boxes[surrBoxes[b]][j];
+                    if (field->type[particleID] != freePart)
+                        continue;
+                    double r2 = 0.0;
+                    for (int i = 0; i < 3; i++)
+                        r2 += (field->pos[i][particleID] - pos[i]) * (field->pos[i][particleID] - pos[i]);
+                    if (r2 > parameter->kh * parameter->kh)
+                        continue;
+                    double W = Wab(sqrt(r2), parameter->kh, parameter->kernel);
+                    double volumeW = field->mass[particleID] / field->density[particleID] * W;
+                    sums[0] += volumeW;
+                    sums[1] += field->mass[particleID] * W;
+                    sums[2] += field->pressure[particleID] * volumeW;
+                    for (int i = 0; i < 3; i++)
+                        sums[3 + i] += field->speed[i][particleID] * volumeW;
+                }
+        }
+    }
+
+    // Each position has one owner
+    MPI_Reduce((subdomainInfo.procID == 0) ? MPI_IN_PLACE : writer.sums.data(), writer.sums.data(),
+               PROBE_SUMS * nPositions, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (subdomainInfo.procID != 0)
+        return;
+
+    // Row of the series (NaN where no free particle is in reach)
+    writer.line.resize(16 * (1 + 5 * nPositions) + 2);
+    char *c = writer.line.data();
+    c += sprintf(c, "%e", currentTime);
+    for (unsigned int p = 0; p < probes.size(); p++)
+    {
+        if (probes[p].type == gaugeProbe)
+            continue;
+        for (int a = writer.probeStart[p]; a < writer.probeStart[p + 1]; a++)
+        {
+            double *sums = &writer.sums[PROBE_SUMS * a];
+            for (int k = 1; k < PROBE_SUMS; k++)
+                c += sprintf(c, "\t%e", (sums[0] > 0.0) ? sums[k] / sums[0] : NAN);
+        }
+    }
+    for (unsigned int p = 0; p < probes.size(); p++)
+        if (probes[p].type == gaugeProbe)
+            c += sprintf(c, "\t%e", gaugeElevation(probes[p], &writer.sums[PROBE_SUMS * writer.probeStart[p]]));
+    *c++ = '\n';
+    writer.file.write(writer.line.data(), c - writer.line.data());
+    if (++writer.rows >= PROBE_FLUSH_ROWS)
+        flushProbes(writer);
+}
+
+/* Writes the rows of the series still in the buffer of the file (e.g. before a checkpoint, so
+   that a killed run does not leave a gap in the series continued by the restart) */
+void flushProbes(ProbeWriter &writer)
+{
+    if (writer.file.is_open())
+        writer.file.flush();
+    writer.rows = 0;
+}
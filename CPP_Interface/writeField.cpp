@@ -1,79 +1,307 @@
 #include "Main.h"
 #include "Interface.h"
 #include "Tools.h"
+#include "Physics.h"
 #include "paraview.h"
+#include "archive.h"
 
 /*
- * In: field = stucture containing value to write
- *     t = time corresponding to the file to write
+ * In: filename, step, scalars, vectors, nbpStart, nbpEnd, indices, format: see paraview
+ *     field = field containing the particles to write
+ *     subdomainInfo = NULL if the whole field is written by process 0
+ * Out: the particles indices[nbpStart..nbpEnd[ of the field in a single file, in the piece
+ *      of this process (and the .pvtp index by process 0) or in a single file
+ *      written by all the processes with MPI-IO, depending on parallelOutput
+ *      returns false if the file of the step (or, for process 0, its index) was not written.
+ *      The index only lists the pieces written, except with the background writer
+ *      (asyncWrite), which cannot communicate: a piece not written is then only removed.
+ */
+static bool writeParaview(std::string const &filename, int step, Field *field,
+                          std::map<std::string, std::vector<double> *> const &scalars,
+                          std::map<std::string, std::vector<double>(*)[3]> const &vectors,
+                          int nbpStart, int nbpEnd, std::vector<int> const &indices, PFormat format,
+                          Parameter *parameter, SubdomainInfo *subdomainInfo)
+{
+    PCompression compression;
+    compression.level = parameter->compressionLevel;
+    compression.filter = (PFilter)parameter->compressionFilter;
+    compression.cellSize = parameter->kh;
+
+    if (subdomainInfo == NULL)
+        return paraview(filename, step, field->pos, scalars, vectors, nbpStart, nbpEnd, &indices, format, -1, compression, parameter->directWrite == 1);
+    if (parameter->parallelOutput == mpiioOutput)
+        return paraviewMPIIO(filename, step, field->pos, scalars, vectors, nbpStart, nbpEnd, &indices);
+
+    int written = paraview(filename, step, field->pos, scalars, vectors, nbpStart, nbpEnd, &indices, format, subdomainInfo->procID, compression, parameter->directWrite == 1) ? 1 : 0;
+    std::vector<int> flags(subdomainInfo->nTasks, 1);
+    if (!subdomainInfo->background)
+        MPI_Gather(&written, 1, MPI_INT, flags.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (subdomainInfo->procID != 0 || (format != XML_BIN && format != XML_BINZ))
+        return written != 0;
+    std::vector<int> pieces;
+    for (int piece = 0; piece < subdomainInfo->nTasks; ++piece)
+        if (flags[piece])
+            pieces.push_back(piece);
+    return !pieces.empty() && paraviewIndex(filename, step, pieces, scalars, vectors);
+}
+
+/*
+ * In: filename, step, parameter, subdomainInfo: see writeParaview
+ * Out: name of the file written by writeParaview (in the Results directory)
+ */
+static std::string paraviewFile(std::string const &filename, int step,
+                                Parameter *parameter, SubdomainInfo *subdomainInfo)
+{
+    std::stringstream s;
+    s << filename << "_" << std::setw(8) << std::setfill('0') << step;
+    s << ((subdomainInfo != NULL && parameter->parallelOutput == pieceOutput) ? ".pvtp" : ".vtp");
+    return s.str();
+}
+
+/*
+ * In: filename, step, field, format, parameter, subdomainInfo: see writeParaview
+ *     fixed = indices of the fixed particles of the field
+ * Out: the fixed particles in <filename>_Boundary, with the initial configuration only
+ *      (staticBoundary = 1, positions only) or at each output (staticBoundary = 2, with
+ *      their density and pressure), and the <filename>_<step>.vtm index that gathers the
+ *      other particles of the step (<filename>_<step>) and the boundary (unless the boundary
+ *      of the step was not written)
+ */
+static void writeBoundary(std::string const &filename, int step, Field *field,
+                          std::vector<int> const &fixed, PFormat format,
+                          Parameter *parameter, SubdomainInfo *subdomainInfo)
+{
+    std::map<std::string, std::vector<double> *> scalars;
+    std::map<std::string, std::vector<double>(*)[3]> vectors; // the fixed particles do not move
+
+    int boundaryStep = (parameter->staticBoundary == 2) ? step : 0;
+    if (boundaryStep == step)
+    {
+        if (parameter->staticBoundary == 2)
+        {
+            std::vector<std::string> const &fields = parameter->fields;
+            if (std::find(fields.begin(), fields.end(), "pressure") != fields.end())
+                scalars["pressure"] = &field->pressure;
+            if (std::find(fields.begin(), fields.end(), "density") != fields.end())
+                scalars["density"] = &field->density;
+        }
+        if (!writeParaview(filename + "_Boundary", boundaryStep, field, scalars, vectors,
+                           0, fixed.size(), fixed, format, parameter, subdomainInfo))
+            return;
+    }
+
+    if (subdomainInfo == NULL || subdomainInfo->procID == 0)
+    {
+        std::vector<std::string> names, files;
+        names.push_back("particles");
+        files.push_back(paraviewFile(filename, step, parameter, subdomainInfo));
+        names.push_back("boundary");
+        files.push_back(paraviewFile(filename + "_Boundary", boundaryStep, parameter, subdomainInfo));
+        paraviewMultiBlock(filename, step, names, files);
+    }
+}
+
+/*
+ * In: field, indices, nbpStart, nbpEnd = particles field->...[indices[nbpStart..nbpEnd[]
+ *     hash = hash of the previous particles
+ * Out: hash (FNV-1a) of the positions, velocities, densities and pressures of the particles
+ */
+static uint64_t hashParticles(Field *field, std::vector<int> const &indices, int nbpStart, int nbpEnd,
+                              uint64_t hash)
+{
+    for (int i = nbpStart; i < nbpEnd; ++i)
+    {
+        int p = indices[i];
+        double values[8] = {field->pos[0][p], field->pos[1][p], field->pos[2][p],
+                            field->speed[0][p], field->speed[1][p], field->speed[2][p],
+                            field->density[p], field->pressure[p]};
+        for (int j = 0; j < 8; ++j)
+        {
+            uint64_t word;
+            memcpy(&word, &values[j], sizeof(uint64_t));
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/*
+ * In: filename, step, field, scalars, vectors, nbpStart, nbpEnd, particles, format,
+ *     parameter, subdomainInfo: see writeParaview
+ *     fixed = fixed particles written apart (see writeBoundary), NULL if none
+ * Out: the particles of the step in the files of the series, and the step added with its
+ *      time to the <filename>.pvd collection (XML formats). With skipUnchanged, the files are
+ *      not written if the particles did not change since the previous output of the series:
+ *      the collection then refers to the files of that output. A step whose files were not
+ *      written is not added to the collection.
+ */
+static void writeSeries(std::string const &filename, int step, Field *field,
+                        std::map<std::string, std::vector<double> *> const &scalars,
+                        std::map<std::string, std::vector<double>(*)[3]> const &vectors,
+                        int nbpStart, int nbpEnd, std::vector<int> const &particles,
+                        std::vector<int> const *fixed, PFormat format,
+                        Parameter *parameter, SubdomainInfo *subdomainInfo)
+{
+    // Last written step of each series and hash of its particles (skipUnchanged)
+    static std::map<std::string, std::pair<int, uint64_t>> lastWritten;
+
+    int written = step;
+    if (parameter->skipUnchanged == 1)
+    {
+        uint64_t hash = hashParticles(field, particles, nbpStart, nbpEnd, 14695981039346656037ULL ^ (nbpEnd - nbpStart));
+        if (fixed != NULL && parameter->staticBoundary == 2)
+            hash = hashParticles(field, *fixed, 0, fixed->size(), hash);
+        std::map<std::string, std::pair<int, uint64_t>>::iterator it = lastWritten.find(filename);
+        if (step != 0 && it != lastWritten.end() && it->second.second == hash)
+            written = it->second.first;
+        else
+            lastWritten[filename] = std::make_pair(step, hash);
+    }
+
+    if (written == step)
+    {
+        if (!writeParaview(filename, step, field, scalars, vectors, nbpStart, nbpEnd, particles, format, parameter, subdomainInfo))
+        {
+            lastWritten.erase(filename);
+            written = -1;
+        }
+        if (fixed != NULL)
+            writeBoundary(filename, step, field, *fixed, format, parameter, subdomainInfo);
+    }
+
+    // The collection is written by the process that writes the index of the pieces
+    if ((format == XML_BIN || format == XML_BINZ) && (subdomainInfo == NULL || subdomainInfo->procID == 0) && written >= 0)
+    {
+        std::string file = paraviewFile(filename, written, parameter, subdomainInfo);
+        if (fixed != NULL)
+            file = file.substr(0, file.rfind('.')) + ".vtm";
+        paraviewCollection(filename, file, field->currentTime, step == 0);
+    }
+}
+
+/*
+ * In: field, first, end = particles [first, end[ of the field (the other ones, e.g. the
+ *                         halos, are only neighbors for the free-surface detection)
+ *     parameter = output filters of the "#outpt" section (freeSurface, roi, minSpeed,
+ *                 minPressure, stride)
+ * Out: selected = the particles that pass the filters (one out of stride among the
+ *      free-surface particles, or all the particles, inside the region of interest and
+ *      above the thresholds); with freeSurface = 2, field->normal is set
+ *      returns false (and selected is not filled) if no filter is set
+ */
+bool selectOutput(Field *field, int first, int end, Parameter *parameter, std::vector<int> &selected)
+{
+    std::vector<double> const &roi = parameter->roi;
+    if (roi.empty() && parameter->stride == 1 && parameter->minSpeed <= 0.0 && parameter->minPressure == -HUGE_VAL &&
+        parameter->freeSurface == 0)
+        return false;
+
+    std::vector<int> candidates;
+    if (parameter->freeSurface != 0)
+        freeSurface(field, first, end, parameter, candidates, parameter->freeSurface == 2);
+    else
+    {
+        candidates.resize(end - first);
+        for (int i = first; i < end; ++i)
+            candidates[i - first] = i;
+    }
+
+    selected.clear();
+    int kept = 0;
+    double minSpeed2 = parameter->minSpeed * parameter->minSpeed;
+    for (unsigned int k = 0; k < candidates.size(); ++k)
+    {
+        int i = candidates[k];
+        bool inside = true;
+        for (int j = 0; j < 3 && !roi.empty(); ++j)
+            inside = inside && roi[j] <= field->pos[j][i] && field->pos[j][i] <= roi[3 + j];
+        double speed2 = field->speed[0][i] * field->speed[0][i] + field->speed[1][i] * field->speed[1][i] +
+                        field->speed[2][i] * field->speed[2][i];
+        if (!inside || speed2 < minSpeed2 || field->pressure[i] < parameter->minPressure)
+            continue;
+        if (kept++ % parameter->stride == 0)
+            selected.push_back(i);
+    }
+    return true;
+}
+
+/*
+ * In: localField = field of the process (the particles of its subdomain are written)
+ *     parameter, subdomainInfo = see gatherField
+ * Out: globalField = on process 0, the particles of all the subdomains that pass the
+ *      output filters: each process selects its particles before the gather
+ */
+void gatherOutput(Field *globalField, Field *localField, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    std::vector<int> selected;
+    bool filtered = selectOutput(localField, subdomainInfo.startingParticle, subdomainInfo.endingParticle + 1,
+                                 parameter, selected);
+    gatherField(globalField, localField, subdomainInfo, filtered ? &selected : NULL, parameter->freeSurface == 2);
+    globalField->outputSelected = filtered;
+}
+
+/*
+ * In: field = stucture containing value to write (at the time field->currentTime)
+ *     step = time step number of the output, used in the file names
  *     filename = Name given to the file
  *     parameterFilename = Fluid parameter file used
  *     geometryFilename = geometry file used
+ *     subdomainInfo = if not NULL, each process writes the particles of its subdomain
+ *                     (parallelOutput, called by all the processes)
  * Out: speed_t.vtk, pos_t.vtk, or .txt
  */
-void writeField(Field *field, double t, Parameter *parameter,
+void writeField(Field *field, int step, Parameter *parameter,
                 std::string const &parameterFilename,
                 std::string const &geometryFilename,
-                std::string const &filename)
+                std::string const &filename,
+                SubdomainInfo *subdomainInfo)
 {
     std::map<std::string, std::vector<double> *> scalars;
     std::map<std::string, std::vector<double>(*)[3]> vectors;
-    Field newFieldInstance;
-    Field *newField = &newFieldInstance;
+    std::vector<int> indices;
     int count = 0;
-    if (parameter->paraview != noParaview || parameter->matlab != noMatlab)
+    int nFixed = 0;
+
+    // Particles to write (the halos are not written) and piece number
+    int first = 0;
+    int end = field->pos[0].size();
+    int piece = -1;
+    if (subdomainInfo != NULL)
     {
-        newField->nFree = field->nFree;
-        newField->nFixed = field->nFixed;
-        newField->nMoving = field->nMoving;
-        newField->l[0] = field->l[0];
-        newField->l[1] = field->l[1];
-        newField->l[2] = field->l[2];
-        newField->u[0] = field->u[0];
-        newField->u[1] = field->u[1];
-        newField->u[2] = field->u[2];
-        newField->currentTime = field->currentTime;
-
-        // Reserves the space for the vectors
-        for (int i = 0; i < 3; i++)
+        first = subdomainInfo->startingParticle;
+        end = subdomainInfo->endingParticle + 1;
+        piece = subdomainInfo->procID;
+    }
+
+    // Indices of the particles to write, free particles first: the writers read the
+    // particles of the field through them instead of a copy of the field. The output
+    // filters are applied here unless the particles were selected before the gather.
+    if (parameter->paraview != noParaview || parameter->matlab != noMatlab || parameter->archive == 1)
+    {
+        std::vector<int> selected;
+        if (field->outputSelected || !selectOutput(field, first, end, parameter, selected))
         {
-            newField->pos[i].reserve(field->nTotal);
-            newField->speed[i].reserve(field->nTotal);
+            selected.resize(end - first);
+            for (int i = first; i < end; ++i)
+                selected[i - first] = i;
         }
-        newField->density.reserve(field->nTotal);
-        newField->pressure.reserve(field->nTotal);
-        newField->mass.reserve(field->nTotal);
-        newField->type.reserve(field->nTotal);
-
-        for (int i = 0; i < field->pos[0].size(); ++i)
+        indices.reserve(selected.size());
+        for (unsigned int k = 0; k < selected.size(); ++k)
         {
-            if (field->type[i] == 0)
+            if (field->type[selected[k]] == 0)
             {
-                newField->pos[0].push_back(field->pos[0][i]);
-                newField->pos[1].push_back(field->pos[1][i]);
-                newField->pos[2].push_back(field->pos[2][i]);
-                newField->speed[0].push_back(field->speed[0][i]);
-                newField->speed[1].push_back(field->speed[1][i]);
-                newField->speed[2].push_back(field->speed[2][i]);
-                newField->density.push_back(field->density[i]);
-                newField->pressure.push_back(field->pressure[i]);
-                newField->mass.push_back(field->mass[i]);
+                indices.push_back(selected[k]);
                 count = count + 1;
             }
         }
-        for (int i = 0; i < field->pos[0].size(); ++i)
+        for (unsigned int k = 0; k < selected.size(); ++k)
         {
+            int i = selected[k];
             if (field->type[i] != 0)
             {
-                newField->pos[0].push_back(field->pos[0][i]);
-                newField->pos[1].push_back(field->pos[1][i]);
-                newField->pos[2].push_back(field->pos[2][i]);
-                newField->speed[0].push_back(field->speed[0][i]);
-                newField->speed[1].push_back(field->speed[1][i]);
-                newField->speed[2].push_back(field->speed[2][i]);
-                newField->density.push_back(field->density[i]);
-                newField->pressure.push_back(field->pressure[i]);
-                newField->mass.push_back(field->mass[i]);
+                if (field->type[i] == fixedPart)
+                    nFixed++;
+                indices.push_back(i);
             }
         }
     }
@@ -81,12 +309,16 @@ void writeField(Field *field, double t, Parameter *parameter,
     // Save results to disk (ParaView or Matlab)
     if (parameter->paraview != noParaview) // .vtk in ParaView
     {
-        scalars["pressure"] = &newField->pressure;
-        scalars["density"] = &newField->density;
-        vectors["velocity"] = &newField->speed;
-
-        // nbr of particles should be multiple of 3
-        int nbp = newField->pos[0].size(), nbpStart, nbpEnd;
+        for (unsigned int i = 0; i < parameter->fields.size(); ++i)
+        {
+            std::string const &name = parameter->fields[i];
+            if (name == "velocity")
+                vectors[name] = &field->speed;
+            else
+                scalars[name] = (name == "pressure") ? &field->pressure : ((name == "density") ? &field->density : &field->mass);
+        }
+        if (parameter->freeSurface == 2)
+            vectors["normal"] = &field->normal;
 
         // !! CHOOSE YOUR FORMAT !!
         //PFormat format = LEGACY_TXT;
@@ -94,13 +326,27 @@ void writeField(Field *field, double t, Parameter *parameter,
         //PFormat format = XML_BIN;
         PFormat format = XML_BINZ;
 
+        // With staticBoundary, the fixed particles are written apart (see writeBoundary)
+        bool boundary = parameter->staticBoundary != 0 && (format == XML_BIN || format == XML_BINZ);
+        std::vector<int> others, fixed;
+        if (boundary)
+        {
+            for (unsigned int i = 0; i < indices.size(); ++i)
+                (field->type[indices[i]] == fixedPart ? fixed : others).push_back(indices[i]);
+        }
+        std::vector<int> const &particles = boundary ? others : indices;
+
+        // nbr of particles should be multiple of 3
+        int nbp = particles.size(), nbpStart, nbpEnd;
+
         // Selection of the output format
         // Full
         if (parameter->paraview == fullParaview)
         {
             nbpStart = 0;
             nbpEnd = nbp;
-            paraview(filename + "_Full", t, newField->pos, scalars, vectors, nbpStart, nbpEnd, format);
+            writeSeries(filename + "_Full", step, field, scalars, vectors, nbpStart, nbpEnd, particles,
+                        boundary ? &fixed : NULL, format, parameter, subdomainInfo);
         }
 
         // Only nFree
@@ -108,7 +354,8 @@ void writeField(Field *field, double t, Parameter *parameter,
         {
             nbpStart = 0;
             nbpEnd = count;
-            paraview(filename + "_Free", t, newField->pos, scalars, vectors, nbpStart, nbpEnd, format);
+            writeSeries(filename + "_Free", step, field, scalars, vectors, nbpStart, nbpEnd, particles,
+                        NULL, format, parameter, subdomainInfo);
         }
 
         // Only nFree and nMoving
@@ -116,35 +363,21 @@ void writeField(Field *field, double t, Parameter *parameter,
         {
             nbpStart = count;
             nbpEnd = nbp;
-            paraview(filename + "_MovingFixed", t, newField->pos, scalars, vectors, nbpStart, nbpEnd, format);
+            writeSeries(filename + "_MovingFixed", step, field, scalars, vectors, nbpStart, nbpEnd, particles,
+                        boundary ? &fixed : NULL, format, parameter, subdomainInfo);
         }
     }
 
     if (parameter->matlab != noMatlab) // .txt in Matlab
-        matlab(filename, parameterFilename, geometryFilename, t, parameter, newField);
-
-    // Free Memory
-    newField->pos[0].clear();
-    newField->pos[0].shrink_to_fit();
-    newField->pos[1].clear();
-    newField->pos[1].shrink_to_fit();
-    newField->pos[2].clear();
-    newField->pos[2].shrink_to_fit();
-    newField->speed[0].clear();
-    newField->speed[0].shrink_to_fit();
-    newField->speed[1].clear();
-    newField->speed[1].shrink_to_fit();
-    newField->speed[2].clear();
-    newField->speed[2].shrink_to_fit();
-    newField->density.clear();
-    newField->density.shrink_to_fit();
-    newField->pressure.clear();
-    newField->pressure.shrink_to_fit();
-    newField->mass.clear();
-    newField->mass.shrink_to_fit();
+        matlab(filename, parameterFilename, geometryFilename, step, parameter, field, indices,
+               count, indices.size() - count - nFixed, nFixed, piece);
+
+    if (parameter->archive == 1) // columns of every output in a single file
+        archiveFrame(filename, step, field->currentTime, field->pos, field->speed, field->density,
+                     field->pressure, field->mass, field->type, indices, step == 0);
 }
 
-// export results to Matlab (.txt)
+// export results to Matlab (.txt, or .bin with matlab = binaryMatlab)
 //   filename: file name without txt extension
 //   pos:     positions (vector of size 3*number of particles)
 //   speed:   velocity  (vector of size 3*number of particles)
@@ -152,12 +385,24 @@ void writeField(Field *field, double t, Parameter *parameter,
 //   pressure:pressure  (vector of size number of particles)
 //   mass:    mass      (vector of size number of particles)
 //   step:    time step number
+//   indices: particles of the field to write, in this order
+//   nFree, nMoving, nFixed: number of particles of each type among them
+//   piece:   number of the piece (process) appended to the file name (-1 = whole field)
+//
+// binary file (native byte order, i.e. little endian on x86, read by Matlab/readBinary.m):
+//   char[8] "SPHBIN1" | uint32 length of the text header | text header of the .txt file
+//   int32 nbp, nFree, nMoving, nFixed
+//   double currentTime, k, writeInterval, T, CPU time, l[3], u[3]
+//   uint64 memory usage, memory usage peak [kB]
+//   9 columns of nbp doubles: posX, posY, posZ, velocityX, velocityY, velocityZ, density, pressure, mass
 void matlab(std::string const &filename,
             std::string const &parameterFilename,
             std::string const &geometryFilename,
-            int step, Parameter *parameter, Field *field)
+            int step, Parameter *parameter, Field *field,
+            std::vector<int> const &indices, int nFree, int nMoving, int nFixed, int piece)
 {
-    int nbp = field->pos[0].size();
+    int nbp = indices.size();
+    bool binary = (parameter->matlab == binaryMatlab);
 
     // Set Chronos and time variable
     std::chrono::time_point<std::chrono::system_clock> start, end;
@@ -174,53 +419,99 @@ void matlab(std::string const &filename,
 
     // build file name + stepno + vtk extension
     std::stringstream s;
-    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step << ".txt";
+    s << "Results/" << filename << "_" << std::setw(8) << std::setfill('0') << step;
+    if (piece >= 0)
+        s << "_" << std::setw(4) << std::setfill('0') << piece;
+    s << (binary ? ".bin" : ".txt");
 
     // open file
     //std::cout << "Writing results to " << s.str() << std::endl;
-    std::ofstream f(s.str().c_str());
-    f << std::scientific;
+    std::ofstream f(s.str().c_str(), binary ? (std::ios::binary | std::ios::out) : std::ios::out);
+    std::ostringstream h; // text header
+    h << std::scientific;
 
     //Record Time
     double duration = (std::clock() - startExperimentTimeClock) / (double)CLOCKS_PER_SEC;
+    size_t memory = GetMemoryProcess(false, false);
+    size_t memoryPeak = GetMemoryProcessPeak(false, false);
     // header
-    f << "#EXPERIMENT: " << filename << std::endl;
-    f << std::endl;
-    f << "Date : " << asctime(timeinfo);
+    h << "#EXPERIMENT: " << filename << std::endl;
+    h << std::endl;
+    h << "Date : " << asctime(timeinfo);
 #if defined(_WIN32) || defined(WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
-    f << "Computer Name : " << getenv("COMPUTERNAME") << std::endl;
-    f << "Username : " << getenv("USERNAME") << std::endl;
+    h << "Computer Name : " << getenv("COMPUTERNAME") << std::endl;
+    h << "Username : " << getenv("USERNAME") << std::endl;
 #elif defined(__unix__) || defined(__unix) || defined(unix) || (defined(__APPLE__) && defined(__MACH__))
-    f << "Computer Name : None" << std::endl; // To be implemented
-    f << "Username : None" << std::endl; // To be implemented
+    h << "Computer Name : None" << std::endl; // To be implemented
+    h << "Username : None" << std::endl; // To be implemented
 #else
 #error "Cannot define GetMemory( ) or GetMemoryProcessPeak( ) or GetMemoryProcess() for an unknown OS." // [RB] ?????
 #endif
-    f << "File Used : " << geometryFilename << "   &   " << parameterFilename << std::endl;
-    f << std::endl;
-    f << "CPU Time : " << duration << " [s]" << std::endl;
-    f << "Memory Usage : " << GetMemoryProcess(false, false) << " [kB]" << std::endl;
-    f << "Memory Usage Peak : " << GetMemoryProcessPeak(false, false) << " [kB]" << std::endl;
-    f << std::endl;
-    f << "Step Time (k) : " << parameter->k << " [s]" << std::endl;
-    f << "Write interval : " << parameter->writeInterval << " [s]" << std::endl;
-    f << "Simulation Time (T) : " << parameter->T << " [s]" << std::endl;
-    f << "Current Time Simulation : " << field->currentTime << " [s]" << std::endl;
-    f << std::endl;
-    f << "Domain (lower l) : " << field->l[0] << "   " << field->l[1] << "   " << field->l[2] << "    [m]" << std::endl;
-    f << "Domain (upper u) : " << field->u[0] << "   " << field->u[1] << "   " << field->u[2] << "    [m]" << std::endl;
-    f << "Number of Particules (nFree/nMoving/nFixed) : " << field->nFree << "   " << field->nMoving << "   " << field->nFixed << std::endl;
-    f << "\n";
-    f << " posX\t        posY\t        posZ\t     velocityX\t     velocityY\t     velocityZ\t     density\t     pressure\t     mass" << std::endl;
-
-    // Fill f:
-    for (int i = 0; i < nbp; ++i)
+    h << "File Used : " << geometryFilename << "   &   " << parameterFilename << std::endl;
+    h << std::endl;
+    h << "CPU Time : " << duration << " [s]" << std::endl;
+    h << "Memory Usage : " << memory << " [kB]" << std::endl;
+    h << "Memory Usage Peak : " << memoryPeak << " [kB]" << std::endl;
+    h << std::endl;
+    h << "Step Time (k) : " << parameter->k << " [s]" << std::endl;
+    h << "Write interval : " << parameter->writeInterval << " [s]" << std::endl;
+    h << "Simulation Time (T) : " << parameter->T << " [s]" << std::endl;
+    h << "Current Time Simulation : " << field->currentTime << " [s]" << std::endl;
+    h << std::endl;
+    h << "Domain (lower l) : " << field->l[0] << "   " << field->l[1] << "   " << field->l[2] << "    [m]" << std::endl;
+    h << "Domain (upper u) : " << field->u[0] << "   " << field->u[1] << "   " << field->u[2] << "    [m]" << std::endl;
+    h << "Number of Particules (nFree/nMoving/nFixed) : " << nFree << "   " << nMoving << "   " << nFixed << std::endl;
+    h << "\n";
+    h << " posX\t        posY\t        posZ\t     velocityX\t     velocityY\t     velocityZ\t     density\t     pressure\t     mass" << std::endl;
+    std::string header = h.str();
+
+    std::vector<double> const *columns[9] = {&field->pos[0], &field->pos[1], &field->pos[2],
+                                             &field->speed[0], &field->speed[1], &field->speed[2],
+                                             &field->density, &field->pressure, &field->mass};
+    if (binary)
+    {
+        uint32_t headerLength = header.size();
+        int32_t counts[4] = {nbp, nFree, nMoving, nFixed};
+        double values[11] = {field->currentTime, parameter->k, parameter->writeInterval, parameter->T, duration,
+                             field->l[0], field->l[1], field->l[2], field->u[0], field->u[1], field->u[2]};
+        uint64_t memories[2] = {memory, memoryPeak};
+        f.write("SPHBIN1", 8);
+        f.write((char const *)&headerLength, sizeof(uint32_t));
+        f.write(header.data(), header.size());
+        f.write((char const *)counts, sizeof(counts));
+        f.write((char const *)values, sizeof(values));
+        f.write((char const *)memories, sizeof(memories));
+
+        // one write per column
+        std::vector<double> column(nbp);
+        for (int c = 0; c < 9; ++c)
+        {
+            for (int k = 0; k < nbp; ++k)
+                column[k] = (*columns[c])[indices[k]];
+            f.write((char const *)column.data(), nbp * sizeof(double));
+        }
+    }
+    else
     {
-        f << field->pos[0][i] << "\t" << field->pos[1][i] << "\t" << field->pos[2][i] << "\t"
-          << field->speed[0][i] << "\t" << field->speed[1][i] << "\t" << field->speed[2][i] << "\t"
-          << field->density[i] << "\t"
-          << field->pressure[i] << "\t"
-          << field->mass[i] << "\t" << std::endl;
+        f << header;
+
+        // Fill f: the lines are formatted in a buffer written by blocks (same format as
+        // std::scientific, but without the flush of std::endl at each particle)
+        std::vector<char> buffer(1 << 20);
+        size_t used = 0;
+        for (int k = 0; k < nbp; ++k)
+        {
+            if (buffer.size() - used < 9 * 32)
+            {
+                f.write(buffer.data(), used);
+                used = 0;
+            }
+            int i = indices[k];
+            for (int c = 0; c < 9; ++c)
+                used += snprintf(&buffer[used], buffer.size() - used, "%e\t", (*columns[c])[i]);
+            buffer[used++] = '\n';
+        }
+        f.write(buffer.data(), used);
     }
 
     // End Chrono
@@ -14,6 +14,9 @@ std::clock_t startExperimentTimeClock;
 *- argv[1]: name of the input parameter file (mandatory)
 *- argv[2]: name of the input geometry file (mandatory)
 *- argv[3]: name of the output result (optional, default name is "result.txt")
+*- --restart (anywhere): restarts from the last checkpoint of the experiment
+*- --walltime=<time> (anywhere): wall-clock time allowed, in seconds or [[hh:]mm:]ss; a checkpoint is
+*  written and the run stops before it is exceeded (as on a SIGTERM or SIGUSR1)
 *
 *Description:
 *Run the SPH solver for a given geometry and a given set of parameter and write the result in an output file.
@@ -43,7 +46,34 @@ int main(int argc, char *argv[])
     std::string parameterFilename;
     std::string geometryFilename;
     std::string experimentFilename;
-    if (argc < 3) // Not enough arguments
+    std::vector<std::string> arguments; // the options (--...) are removed
+    bool restart = false;
+    double walltime = 0.0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--restart")
+            restart = true;
+        else if (argument.compare(0, 11, "--walltime=") == 0)
+        {
+            walltime = readWalltime(argument.substr(11));
+            if (walltime <= 0.0)
+            {
+                std::cout << "Invalid walltime " << argument.substr(11) << ".\n"
+                          << std::endl;
+                errorFlag = argumentError;
+            }
+        }
+        else if (argument.compare(0, 2, "--") == 0)
+        {
+            std::cout << "Unknown option " << argument << ".\n"
+                      << std::endl;
+            errorFlag = argumentError;
+        }
+        else
+            arguments.push_back(argument);
+    }
+    if (arguments.size() < 2 || errorFlag != noError) // Not enough arguments
     {
         std::cout << "Invalid input files.\n"
                   << std::endl;
@@ -51,17 +81,17 @@ int main(int argc, char *argv[])
         MPI_Finalize();
         return errorFlag; // [RB] tester des exceptions?
     }
-    else if (argc < 4) // Use default name for the experiment (result)
+    else if (arguments.size() < 3) // Use default name for the experiment (result)
     {
-        parameterFilename = argv[1];
-        geometryFilename = argv[2];
+        parameterFilename = arguments[0];
+        geometryFilename = arguments[1];
         experimentFilename = "result";
     }
     else
     {
-        parameterFilename = argv[1];
-        geometryFilename = argv[2];
-        experimentFilename = argv[3];
+        parameterFilename = arguments[0];
+        geometryFilename = arguments[1];
+        experimentFilename = arguments[2];
     }
 
     // Main variables declaration
@@ -74,44 +104,109 @@ int main(int argc, char *argv[])
     Field globalFieldInstance;                 // Used by node 0 only
     Field *globalField = &globalFieldInstance; // Used by node 0 only // [RB] inutile
 
-    // Reads parameters (each process) and geometry (process 0) and checks their consistency
+    // Reads parameters (each process) and geometry (process 0, or each process with
+    // the distributed initialization) and checks their consistency
     errorFlag = readParameter(parameterFilename, parameter);
     if (errorFlag != noError)
     {
         MPI_Finalize();
         return errorFlag; // [RB] tester des exceptions?
     }
-    if (subdomainInfo.procID == 0)
+    Checkpoint checkpoint;
+    checkpoint.walltime = walltime;
+    startCheckpoints(checkpoint, experimentFilename, parameterFilename, geometryFilename, subdomainInfo, restart);
+    if (restart)
     {
-        errorFlag = initializeField(geometryFilename, globalField, parameter);
+        // Particles, subdomains and state of the time loop of the last checkpoint
+        errorFlag = readCheckpoint(checkpoint, currentField, globalField, parameter, subdomainInfo);
+        if (errorFlag != noError)
+        {
+            MPI_Finalize();
+            return errorFlag; // [RB] tester des exceptions?
+        }
     }
-    MPI_Bcast(&errorFlag, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    if (errorFlag != noError)
+    else if (parameter->distributedInit == 1)
     {
-        MPI_Finalize();
-        return errorFlag; // [RB] tester des exceptions?
-    }
+        // Each process generates and initializes the particles of its subdomain only
+        errorFlag = initializeField(geometryFilename, currentField, parameter, &subdomainInfo);
+        MPI_Allreduce(MPI_IN_PLACE, &errorFlag, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        if (errorFlag != noError)
+        {
+            MPI_Finalize();
+            return errorFlag; // [RB] tester des exceptions?
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            globalField->l[i] = currentField->l[i];
+            globalField->u[i] = currentField->u[i];
+        }
+        setupLocalField(*currentField, parameter, subdomainInfo);
 
-    // Writes the initial configuration
-    if (subdomainInfo.procID == 0)
+        // Writes the initial configuration
+        if (parameter->parallelOutput == gatheredOutput)
+        {
+            gatherOutput(globalField, currentField, parameter, subdomainInfo);
+            if (subdomainInfo.procID == 0)
+            {
+                writeField(globalField, 0.0, parameter, parameterFilename, geometryFilename, experimentFilename);
+            }
+        }
+    }
+    else
     {
-        writeField(globalField, 0.0, parameter, parameterFilename, geometryFilename, experimentFilename);
+        if (subdomainInfo.procID == 0)
+        {
+            errorFlag = initializeField(geometryFilename, globalField, parameter);
+        }
+        MPI_Bcast(&errorFlag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (errorFlag != noError)
+        {
+            MPI_Finalize();
+            return errorFlag; // [RB] tester des exceptions?
+        }
+
+        // Writes the initial configuration
+        if (subdomainInfo.procID == 0 && parameter->parallelOutput == gatheredOutput)
+        {
+            writeField(globalField, 0.0, parameter, parameterFilename, geometryFilename, experimentFilename);
+        }
+
+        // Scatters the globalField from node 0 into the currentField of all nodes
+        errorFlag = scatterField(globalField, currentField, parameter, subdomainInfo);
+        if (errorFlag != noError)
+        {
+            MPI_Finalize();
+            return errorFlag; // [RB] tester des exceptions?
+        }
     }
-    unsigned int writeCount = 1;
 
-    // Scatters the globalField from node 0 into the currentField of all nodes
-    errorFlag = scatterField(globalField, currentField, parameter, subdomainInfo);
-    if (errorFlag != noError)
+    // Each process writes the initial configuration of its subdomain
+    if (parameter->parallelOutput != gatheredOutput && !restart)
     {
-        MPI_Finalize();
-        return errorFlag; // [RB] tester des exceptions?
+        writeField(currentField, 0.0, parameter, parameterFilename, geometryFilename, experimentFilename, &subdomainInfo);
     }
 
+    // Initial load balancing (particle count only: no compute time measured yet)
+    if (parameter->balanceInterval > 0 && !restart)
+        balanceLoad(*currentField, parameter, subdomainInfo);
+
+    // Background writer of the results
+    OutputWriter writer;
+    if (parameter->asyncWrite == 1)
+        startOutputWriter(writer, parameterFilename, geometryFilename, experimentFilename, parameter, subdomainInfo);
+
     // Declares the box mesh and determines their adjacent relations variables
     std::vector<std::vector<int>> boxes;
     std::vector<std::vector<int>> surrBoxesAll;
     boxMesh(currentField->l, currentField->u, subdomainInfo.boxSize, boxes, surrBoxesAll);
 
+    // Probes: time series of the interpolated field, from the initial configuration (continued on a restart)
+    ProbeWriter probes;
+    startProbes(probes, experimentFilename, parameterFilename, parameter, subdomainInfo,
+                restart ? checkpoint.currentTime : -1.0);
+    if (!restart)
+        sampleProbes(probes, currentField, 0.0, parameter, subdomainInfo, boxes, surrBoxesAll);
+
     // Copies the invariant information about the field
     copyField(currentField, nextField);
 
@@ -123,6 +218,12 @@ int main(int argc, char *argv[])
         std::cout << "Done.\n"
                   << std::endl;
 
+    // Number of free, fixed and moving particles (process 0 may not hold the whole field)
+    int nParticles[3] = {0, 0, 0};
+    for (int i = subdomainInfo.startingParticle; i <= subdomainInfo.endingParticle; i++)
+        nParticles[(currentField->type[i] == freePart) ? 0 : ((currentField->type[i] == fixedPart) ? 1 : 2)]++;
+    MPI_Allreduce(MPI_IN_PLACE, nParticles, 3, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
     // Information on the simulation
     if (subdomainInfo.procID == 0)
     {
@@ -137,11 +238,11 @@ int main(int argc, char *argv[])
                       << "not defined (adaptative time step)"
                       << "\n"
                       << std::endl;
-        std::cout << "Number of free particles = " << globalField->nFree << "\n"
+        std::cout << "Number of free particles = " << nParticles[0] << "\n"
                   << std::endl;
-        std::cout << "Number of fixed particles = " << globalField->nFixed << "\n"
+        std::cout << "Number of fixed particles = " << nParticles[1] << "\n"
                   << std::endl;
-        std::cout << "Number of particles with imposed speed = " << globalField->nMoving << "\n"
+        std::cout << "Number of particles with imposed speed = " << nParticles[2] << "\n"
                   << std::endl;
     }
 
@@ -151,10 +252,14 @@ int main(int argc, char *argv[])
         std::cout << "Time integration progress:\n"
                   << std::endl;
         std::cout << "0%-----------------------------------------------100%\n[";
+        std::cout << std::string(checkpoint.loadingBar, '>') << std::flush;
     }
-    unsigned int loadingBar = 0;
-    double currentTime = 0.0; // Current time of the simulation
-    for (unsigned int n = 1; currentTime < parameter->T; n++)
+    unsigned int writeCount = checkpoint.writeCount;
+    unsigned int loadingBar = checkpoint.loadingBar;
+    double currentTime = checkpoint.currentTime; // Current time of the simulation
+    unsigned int stoppedStep = 0;                // Last time step if the run is stopped before T
+    bool checkpointed = false;                   // the last checkpoint due was written
+    for (unsigned int n = checkpoint.step + 1; currentTime < parameter->T; n++)
     {
         // Previous time step for reference
         currentField->nextK = parameter->k;
@@ -177,17 +282,45 @@ int main(int argc, char *argv[])
         // ---
 
         // Major MPI communication: the local field is updated
-        processUpdate(*currentField, subdomainInfo);
+        processUpdate(*currentField, parameter, subdomainInfo);
+
+        // Dynamic load balancing: the box mesh follows the new subdomain limits
+        if (parameter->balanceInterval > 0 && n % parameter->balanceInterval == 0)
+        {
+            if (balanceLoad(*currentField, parameter, subdomainInfo))
+            {
+                boxes.clear();
+                surrBoxesAll.clear();
+                boxMesh(currentField->l, currentField->u, subdomainInfo.boxSize, boxes, surrBoxesAll);
+            }
+        }
+
+        // Sample the probes when needed
+        if (n % parameter->probeInterval == 0)
+            sampleProbes(probes, currentField, currentTime, parameter, subdomainInfo, boxes, surrBoxesAll);
 
         // Write field when needed
         if (writeCount * parameter->writeInterval <= currentTime + 0.000001 * currentTime)
         {
-            gatherField(globalField, currentField, subdomainInfo);
-            globalField->currentTime = currentTime;
-            if (subdomainInfo.procID == 0)
+            if (parameter->asyncWrite == 1 && parameter->parallelOutput != mpiioOutput)
+            {
+                queueOutput(writer, currentField, globalField, n, currentTime, parameter, subdomainInfo);
+            }
+            else if (parameter->parallelOutput == gatheredOutput)
             {
-                writeField(globalField, n, parameter, parameterFilename, geometryFilename, experimentFilename);
+                gatherOutput(globalField, currentField, parameter, subdomainInfo);
+                globalField->currentTime = currentTime;
+                if (subdomainInfo.procID == 0)
+                {
+                    writeField(globalField, n, parameter, parameterFilename, geometryFilename, experimentFilename);
+                }
             }
+            else
+            {
+                currentField->currentTime = currentTime;
+                writeField(currentField, n, parameter, parameterFilename, geometryFilename, experimentFilename, &subdomainInfo);
+            }
+            flushProbes(probes);
             writeCount++;
         }
 
@@ -197,8 +330,30 @@ int main(int argc, char *argv[])
             std::cout << ">" << std::flush;
             loadingBar++;
         }
+
+        // Checkpoint of the whole state when needed (and stop on a signal or before the walltime)
+        bool stop = false;
+        if (checkpointDue(checkpoint, n, parameter, subdomainInfo, stop))
+        {
+            checkpoint.step = n;
+            checkpoint.currentTime = currentTime;
+            checkpoint.writeCount = writeCount;
+            checkpoint.loadingBar = loadingBar;
+            // The outputs still queued are written first: they are counted as done by the checkpoint
+            flushOutputWriter(writer);
+            flushProbes(probes);
+            checkpointed = writeCheckpoint(checkpoint, currentField, globalField, parameter, subdomainInfo);
+        }
+        if (stop && currentTime < parameter->T)
+        {
+            stoppedStep = n;
+            break;
+        }
     }
 
+    // Waits for the last results
+    stopOutputWriter(writer);
+
     // Time information printing
     if (subdomainInfo.procID == 0)
     {
@@ -209,9 +364,16 @@ int main(int argc, char *argv[])
                   << std::endl;
         std::cout << "Real elapsed time \t" << final - start << "\n";
         std::cout << "Clock estimated time \t" << (std::clock() - startExperimentTimeClock) / (double)CLOCKS_PER_SEC << "\n";
+        if (stoppedStep != 0 && checkpointed)
+            std::cout << "Stopped after the checkpoint of step " << stoppedStep << " (time " << currentTime
+                      << "): continue with --restart\n";
+        else if (stoppedStep != 0)
+            std::cout << "Stopped at step " << stoppedStep << " (time " << currentTime
+                      << ") without a checkpoint: --restart continues from the previous one\n";
     }
 
     // MPI Finalize
+    freeHaloRequests(subdomainInfo);
     MPI_Finalize();
 
     //*/
@@ -0,0 +1,80 @@
+///**************************************************************************
+/// SOURCE: Reader of the columnar archive of the results (archive=1).
+///**************************************************************************
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include "archive.h"
+
+/*
+*Input:
+*- argv[1]: name of an archive written by sph (mandatory)
+*- argv[2]: "energy" or "gauge" (optional)
+*- argv[3..5]: x, y and radius of the gauge
+*
+*Description:
+*Lists the frames of the archive (step, time, number of particles). With "energy", gives at each
+*frame the kinetic energy of the free particles, the sum of their mass times their height (the
+*potential energy divided by g) and their largest velocity. With "gauge x y radius", gives at
+*each frame the height of the highest free particle within radius of the vertical (x, y).
+*/
+int main(int argc, char *argv[])
+{
+    std::string mode = (argc > 2) ? argv[2] : "";
+    if (argc < 2 || (mode != "" && mode != "energy" && mode != "gauge") || (mode == "gauge" && argc < 6))
+    {
+        std::cout << "Usage: readarchive Results/result_archive.bin [energy | gauge x y radius]\n";
+        return EXIT_FAILURE;
+    }
+    ArchiveReader archive;
+    if (!archive.open(argv[1]))
+    {
+        std::cout << "Invalid input file: not an archive written by sph.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::scientific << std::setprecision(6);
+    for (size_t f = 0; f < archive.frames(); ++f)
+    {
+        size_t nbp = archive.particles(f);
+        int32_t const *type = archive.type(f);
+        double const *pos[3] = {archive.column(f, ARCHIVE_POSX), archive.column(f, ARCHIVE_POSY),
+                                archive.column(f, ARCHIVE_POSZ)};
+        double const *speed[3] = {archive.column(f, ARCHIVE_SPEEDX), archive.column(f, ARCHIVE_SPEEDY),
+                                  archive.column(f, ARCHIVE_SPEEDZ)};
+        double const *mass = archive.column(f, ARCHIVE_MASS);
+
+        if (mode == "energy")
+        {
+            double kinetic = 0.0, height = 0.0, maxSpeed = 0.0;
+            for (size_t i = 0; i < nbp; ++i)
+            {
+                if (type[i] != 0)
+                    continue;
+                double speed2 = speed[0][i] * speed[0][i] + speed[1][i] * speed[1][i] + speed[2][i] * speed[2][i];
+                kinetic += 0.5 * mass[i] * speed2;
+                height += mass[i] * pos[2][i];
+                maxSpeed = std::max(maxSpeed, std::sqrt(speed2));
+            }
+            std::cout << archive.time(f) << '\t' << kinetic << '\t' << height << '\t' << maxSpeed << '\n';
+        }
+        else if (mode == "gauge")
+        {
+            double x = atof(argv[3]), y = atof(argv[4]), radius = atof(argv[5]);
+            double elevation = NAN;
+            for (size_t i = 0; i < nbp; ++i)
+            {
+                double dx = pos[0][i] - x, dy = pos[1][i] - y;
+                if (type[i] == 0 && dx * dx + dy * dy <= radius * radius && !(pos[2][i] <= elevation))
+                    elevation = pos[2][i];
+            }
+            std::cout << archive.time(f) << '\t' << elevation << '\n';
+        }
+        else
+            std::cout << "frame " << f << "\tstep " << archive.step(f) << "\ttime " << archive.time(f)
+                      << "\t" << nbp << " particles\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+///**************************************************************************
+/// SOURCE: Decoder of the filtered .vtp files (compressionFilter) and
+///         comparison of the pre-compression filters on a result file.
+///**************************************************************************
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "paraview.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+// appended array of a .vtp file
+struct VTPArray
+{
+    std::string name;
+    std::string type;
+    int dim = 1;
+    std::string filter;            // value of the filter attribute ("" if none)
+    size_t tagStart, tagEnd;       // position of the DataArray tag in the header
+    size_t stored = 0;             // bytes in the file (block headers included)
+    std::vector<uint32_t> values;  // decoded 4-byte values
+};
+
+/*
+*Input:
+*- tag: DataArray tag
+*- name: name of the attribute
+*Output:
+*- value of the attribute ("" if absent)
+*/
+static std::string attribute(std::string const &tag, std::string const &name)
+{
+    size_t start = tag.find(" " + name + "=\"");
+    if (start == std::string::npos)
+        return "";
+    start += name.size() + 3;
+    return tag.substr(start, tag.find('"', start) - start);
+}
+
+/*
+*Input:
+*- file: content of the .vtp file
+*- data: position of the appended data
+*- array: array whose tag is read
+*Output:
+*- true if the array is decoded
+*Description:
+*Uncompresses the blocks of an appended array and reverts its filter.
+*/
+static bool decodeArray(std::string const &file, size_t data, VTPArray &array)
+{
+#ifdef USE_ZLIB
+    std::string tag = file.substr(array.tagStart, array.tagEnd - array.tagStart);
+    array.name = attribute(tag, "Name");
+    array.type = attribute(tag, "type");
+    array.filter = attribute(tag, "filter");
+    if (!attribute(tag, "NumberOfComponents").empty())
+        array.dim = atoi(attribute(tag, "NumberOfComponents").c_str());
+
+    // blocks description [nblocks][blocksize][lastblocksize][compressed sizes...]
+    uint32_t const *header = (uint32_t const *)&file[data + atol(attribute(tag, "offset").c_str())];
+    uint32_t nblocks = header[0];
+    size_t blockSize = header[1];
+    size_t last = (header[2] == 0) ? blockSize : header[2];
+    size_t rawSize = (nblocks == 0) ? 0 : (nblocks - 1) * blockSize + last;
+    std::vector<char> raw(rawSize);
+    char const *packed = (char const *)(header + 3 + nblocks);
+    array.stored = (3 + nblocks) * sizeof(uint32_t);
+    for (uint32_t b = 0; b < nblocks; ++b)
+    {
+        uLongf destlen = (b == nblocks - 1) ? last : blockSize;
+        if (uncompress((Bytef *)raw.data() + b * blockSize, &destlen, (Bytef const *)packed, header[3 + b]) != Z_OK)
+            return false;
+        packed += header[3 + b];
+        array.stored += header[3 + b];
+    }
+
+    // filter reverted in the opposite order
+    array.values.resize(rawSize / sizeof(uint32_t));
+    if (array.filter.find("shuffle") != std::string::npos)
+        unshuffleBytes(raw.data(), (char *)array.values.data(), array.values.size());
+    else
+        std::copy(raw.begin(), raw.end(), (char *)array.values.data());
+    if (array.filter.find("delta") != std::string::npos)
+        deltaDecode(array.values.data(), array.values.size(), array.dim);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+*Input:
+*- argv[1]: name of a compressed .vtp file written by sph (mandatory)
+*- argv[2]: name of the decoded .vtp file (optional)
+*
+*Description:
+*Decodes the arrays of the .vtp file and reports, for each pre-compression filter, the size of
+*the file and the compression throughput. If argv[2] is given, writes the arrays without filter
+*in a standard .vtp file that ParaView can open.
+*/
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: vtpfilter input.vtp [output.vtp]\n";
+        return EXIT_FAILURE;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    std::stringstream content;
+    content << in.rdbuf();
+    std::string file = content.str();
+
+    size_t appended = file.find("<AppendedData");
+    if (appended == std::string::npos || file.find("vtkZLibDataCompressor") > appended ||
+        file.find("header_type=\"UInt32\"") > appended)
+    {
+        std::cout << "Invalid input file: not a compressed .vtp written by sph.\n";
+        return EXIT_FAILURE;
+    }
+    size_t data = file.find('_', appended) + 1;
+    int nbp = atoi(attribute(file.substr(0, appended), "NumberOfPoints").c_str());
+
+    // decodes the arrays
+    std::vector<VTPArray> arrays;
+    for (size_t start = file.find("<DataArray"); start < appended; start = file.find("<DataArray", start + 1))
+    {
+        VTPArray array;
+        array.tagStart = start;
+        array.tagEnd = file.find("/>", start);
+        if (!decodeArray(file, data, array))
+        {
+            std::cout << "Invalid input file: array " << arrays.size() << " cannot be decoded.\n";
+            return EXIT_FAILURE;
+        }
+        arrays.push_back(array);
+    }
+
+    size_t raw = 0, stored = 0;
+    std::cout << std::left << std::setw(16) << "array" << std::setw(16) << "filter"
+              << std::right << std::setw(12) << "raw" << std::setw(12) << "stored" << '\n';
+    for (size_t a = 0; a < arrays.size(); ++a)
+    {
+        if (arrays[a].values.empty())
+            continue;
+        std::cout << std::left << std::setw(16) << arrays[a].name << std::setw(16)
+                  << (arrays[a].filter.empty() ? "none" : arrays[a].filter) << std::right
+                  << std::setw(12) << arrays[a].values.size() * sizeof(uint32_t)
+                  << std::setw(12) << arrays[a].stored << '\n';
+        raw += arrays[a].values.size() * sizeof(uint32_t);
+        stored += arrays[a].stored;
+    }
+    std::cout << "total " << raw << " -> " << stored << " bytes\n\n";
+
+    // cells of about the mean spacing of the particles (kh is not known here)
+    std::vector<double> pos[3];
+    double cellSize = 0.0;
+    for (size_t a = 0; a < arrays.size(); ++a)
+        if (arrays[a].name == "Points")
+        {
+            double volume = 1.0;
+            for (int j = 0; j < 3; ++j)
+            {
+                pos[j].resize(nbp);
+                for (int i = 0; i < nbp; ++i)
+                    pos[j][i] = *(float *)&arrays[a].values[3 * i + j];
+                if (nbp > 0)
+                    volume *= *std::max_element(pos[j].begin(), pos[j].end()) -
+                              *std::min_element(pos[j].begin(), pos[j].end());
+            }
+            if (nbp > 0)
+                cellSize = std::cbrt(volume / nbp);
+        }
+
+    // every filter on the same values (the particles are sorted by cell for SHUFFLE_DELTA)
+    const char *filterNames[3] = {"none", "shuffle", "delta+shuffle"};
+    std::vector<int> order;
+    std::ostream null(NULL);
+    std::cout << std::left << std::setw(16) << "filter" << std::right << std::setw(12) << "stored"
+              << std::setw(10) << "ratio" << std::setw(12) << "MB/s" << '\n';
+    for (int filter = NO_FILTER; filter <= SHUFFLE_DELTA; ++filter)
+    {
+        PCompression compression;
+        compression.filter = (PFilter)filter;
+        if (filter == SHUFFLE_DELTA)
+            cellOrder(pos, 0, nbp, NULL, cellSize, order);
+
+        size_t written = 0;
+        double seconds = 0.0;
+        for (size_t a = 0; a < arrays.size(); ++a)
+        {
+            std::vector<uint32_t> values(arrays[a].values);
+            if (filter == SHUFFLE_DELTA && arrays[a].type == "Float32" && (int)values.size() == nbp * arrays[a].dim)
+                for (int i = 0; i < nbp; ++i)
+                    for (int j = 0; j < arrays[a].dim; ++j)
+                        values[i * arrays[a].dim + j] = arrays[a].values[order[i] * arrays[a].dim + j];
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            written += write_filteredXML(null, values.data(), values.size(), arrays[a].dim,
+                                         arrays[a].name == "Points", true, compression);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << std::left << std::setw(16) << filterNames[filter] << std::right
+                  << std::setw(12) << written << std::setw(10) << std::fixed << std::setprecision(2)
+                  << (double)raw / written << std::setw(12) << std::setprecision(1)
+                  << raw / seconds / 1.0e6 << '\n';
+    }
+
+    // standard .vtp: same header without the filter attributes and with the new offsets
+    if (argc > 2)
+    {
+        std::ofstream out(argv[2], std::ios::binary);
+        std::stringstream appendedData;
+        PCompression compression;
+        size_t offset = 0, copied = 0;
+        for (size_t a = 0; a < arrays.size(); ++a)
+        {
+            std::string tag = file.substr(arrays[a].tagStart, arrays[a].tagEnd - arrays[a].tagStart);
+            if (!arrays[a].filter.empty())
+                tag.erase(tag.find(" filter=\""), arrays[a].filter.size() + 10);
+            size_t at = tag.find(" offset=\"") + 9;
+            std::stringstream newOffset;
+            newOffset << offset;
+            tag.replace(at, tag.find('"', at) - at, newOffset.str());
+
+            out << file.substr(copied, arrays[a].tagStart - copied) << tag;
+            copied = arrays[a].tagEnd;
+            offset += write_blockXML(appendedData, (char const *)arrays[a].values.data(),
+                                     arrays[a].values.size() * sizeof(uint32_t), true, compression);
+        }
+        out << file.substr(copied, data - copied) << appendedData.rdbuf();
+        out << "  </AppendedData>\n</VTKFile>\n";
+    }
+
+    return EXIT_SUCCESS;
+}
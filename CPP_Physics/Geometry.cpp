@@ -8,9 +8,10 @@
 //  - s: particle spacing
 //  - (optional) pertubation: percentage of perturbation in position of particles (equal 0 by default)
 //  - (optional) stack: reduce L[3] by s/2 in order to stack cube (equal 0 by default)
+//  - (optional) region: only the particles owned by this process are kept (all of them by default)
 
 void meshcylinder(double o[3], double L[3], double s, std::vector<double> &pos, int *nPart, double *volPart,
-                  double perturbation, bool stack)
+                  double perturbation, bool stack, SubdomainInfo *region)
 {
     // if we stack the cylinder:
     if (stack == true)
@@ -45,7 +46,9 @@ void meshcylinder(double o[3], double L[3], double s, std::vector<double> &pos,
       */
 
     // memory allocation
-    pos.reserve(pos.size() + (*nPart) * 3);
+    if (region == NULL)
+        pos.reserve(pos.size() + (*nPart) * 3);
+    int nStart = pos.size() / 3;
 
     // generates number in the range -s*perturbation % and s*perturbation %
     std::default_random_engine generator;
@@ -62,15 +65,21 @@ void meshcylinder(double o[3], double L[3], double s, std::vector<double> &pos,
             {
                 if (j * s > -sqrt(pow(b, 2) * (1 - (pow(tmpx, 2) / pow(a, 2)))) && j * s <= sqrt(pow(b, 2) * (1 - (pow(tmpx, 2) / pow(a, 2)))))
                 {
-                    double x = o[0] + i * dr1;
-                    double y = o[1] + j * dr2;
-                    pos.push_back(x + distribution(generator));
-                    pos.push_back(y + distribution(generator));
-                    pos.push_back(z + distribution(generator));
+                    double x = o[0] + i * dr1 + distribution(generator);
+                    double y = o[1] + j * dr2 + distribution(generator);
+                    double zPert = z + distribution(generator);
+                    if (ownsPosition(x, y, zPert, region))
+                    {
+                        pos.push_back(x);
+                        pos.push_back(y);
+                        pos.push_back(zPert);
+                    }
                 }
             }
         }
     }
+    // Particles actually generated
+    (*nPart) = pos.size() / 3 - nStart;
 }
 
 //  Build a sphere of regulary aligned particles with the center of mass at o(x,y,z).
@@ -142,7 +151,10 @@ void meshsphere(double o[3], double L[3], double s, std::vector<double> &pos, in
 */
 }
 
-void meshcube(double o[3], double L[3], double teta[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation, bool stack)
+// Build a cube of regulary aligned particles with the center of mass at o(x,y,z), rotated by teta (degrees).
+//  - (optional) region: only the particles owned by this process are kept (all of them by default)
+
+void meshcube(double o[3], double L[3], double teta[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation, bool stack, SubdomainInfo *region)
 {
     // if we stack the cube:
     if (stack == true)
@@ -205,45 +217,6 @@ void meshcube(double o[3], double L[3], double teta[3], double s, std::vector<do
     std::cout << "\t=> "<<ni<< "*"  <<nj<< "*"  <<nk<< " = " << (*nPart) << " particles to be generated\n";
     */
 
-    // memory allocation
-    pos.reserve(pos.size() + ni * nj * nk * 3);
-
-    // generates number in the range -s*perturbation % and s*perturbation %
-    std::default_random_engine generator; // A seed must be used to change value at each call
-    std::uniform_real_distribution<double> distribution(-s * perturbation / 100, s * perturbation / 100);
-
-    // particle generation
-    for (int k = 0; k < nk; ++k)
-    {
-        double z = o[2] - L[2] / 2 + k * dz;
-        if (flag3 == 1)
-        {
-            z = o[2];
-        }
-        for (int j = 0; j < nj; ++j)
-        {
-            double y = o[1] - L[1] / 2 + j * dy;
-            if (flag2 == 1)
-            {
-                y = o[1];
-            }
-            for (int i = 0; i < ni; ++i)
-            {
-                double x = o[0] - L[0] / 2 + i * dx;
-                if (flag1 == 1)
-                {
-                    x = o[0];
-                }
-                pos.push_back(x + distribution(generator));
-                pos.push_back(y + distribution(generator));
-                pos.push_back(z + distribution(generator));
-            }
-        }
-    }
-
-    int n_block = 3 * nk * nj * ni;
-    int n_total = pos.size();
-    int start = (n_total - n_block) / 3;
     // creation matrice rotation
     std::vector<double> Rx(9, 0);
     std::vector<double> Ry(9, 0);
@@ -291,27 +264,60 @@ void meshcube(double o[3], double L[3], double teta[3], double s, std::vector<do
     double R23 = (Rz[3] * Ry[0] + Rz[4] * Ry[3] + Rz[5] * Ry[6]) * Rx[2] + (Rz[3] * Ry[1] + Rz[4] * Ry[4] + Rz[5] * Ry[7]) * Rx[5] + (Rz[3] * Ry[2] + Rz[4] * Ry[5] + Rz[5] * Ry[8]) * Rx[8];
     double R33 = (Rz[6] * Ry[0] + Rz[7] * Ry[3] + Rz[8] * Ry[6]) * Rx[2] + (Rz[6] * Ry[1] + Rz[7] * Ry[4] + Rz[8] * Ry[7]) * Rx[5] + (Rz[6] * Ry[2] + Rz[7] * Ry[5] + Rz[8] * Ry[8]) * Rx[8];
 
-    for (int i = start; i < (n_total) / 3; ++i)
+    // memory allocation
+    if (region == NULL)
+        pos.reserve(pos.size() + ni * nj * nk * 3);
+    int nStart = pos.size() / 3;
+
+    // generates number in the range -s*perturbation % and s*perturbation %
+    std::default_random_engine generator; // A seed must be used to change value at each call
+    std::uniform_real_distribution<double> distribution(-s * perturbation / 100, s * perturbation / 100);
+
+    // particle generation (rotated around o, then kept if owned)
+    for (int k = 0; k < nk; ++k)
     {
-        pos[3 * i] = pos[3 * i] - o[0];
-        pos[3 * i + 1] = pos[3 * i + 1] - o[1];
-        pos[3 * i + 2] = pos[3 * i + 2] - o[2];
-
-        double temp1 = R11 * pos[3 * i] + R12 * pos[3 * i + 1] + R13 * pos[3 * i + 2];
-        double temp2 = R21 * pos[3 * i] + R22 * pos[3 * i + 1] + R23 * pos[3 * i + 2];
-        double temp3 = R31 * pos[3 * i] + R32 * pos[3 * i + 1] + R33 * pos[3 * i + 2];
-        pos[3 * i] = temp1;
-        pos[3 * i + 1] = temp2;
-        pos[3 * i + 2] = temp3;
-
-        pos[3 * i] = pos[3 * i] + o[0];
-        pos[3 * i + 1] = pos[3 * i + 1] + o[1];
-        pos[3 * i + 2] = pos[3 * i + 2] + o[2];
+        double z = o[2] - L[2] / 2 + k * dz;
+        if (flag3 == 1)
+        {
+            z = o[2];
+        }
+        for (int j = 0; j < nj; ++j)
+        {
+            double y = o[1] - L[1] / 2 + j * dy;
+            if (flag2 == 1)
+            {
+                y = o[1];
+            }
+            for (int i = 0; i < ni; ++i)
+            {
+                double x = o[0] - L[0] / 2 + i * dx;
+                if (flag1 == 1)
+                {
+                    x = o[0];
+                }
+                double px = x + distribution(generator) - o[0];
+                double py = y + distribution(generator) - o[1];
+                double pz = z + distribution(generator) - o[2];
+
+                double temp1 = R11 * px + R12 * py + R13 * pz + o[0];
+                double temp2 = R21 * px + R22 * py + R23 * pz + o[1];
+                double temp3 = R31 * px + R32 * py + R33 * pz + o[2];
+                if (ownsPosition(temp1, temp2, temp3, region))
+                {
+                    pos.push_back(temp1);
+                    pos.push_back(temp2);
+                    pos.push_back(temp3);
+                }
+            }
+        }
     }
+    // Particles actually generated
+    (*nPart) = pos.size() / 3 - nStart;
 }
 
 int interpBathymetry(double *sTrue, int *n, double xa, double xb, double ya, double yb, double height0, double hFreeSurface,
-                     int Nx, int Ny, double *bath, std::vector<double> &posFree, std::vector<double> &posFixed, double perturbation)
+                     int Nx, int Ny, double *bath, std::vector<double> &posFree, std::vector<double> &posFixed, double perturbation,
+                     SubdomainInfo *region)
 {
     int nFreeTotal = 0;
     double dx = (xb - xa) / (double)Nx;
@@ -370,19 +376,31 @@ int interpBathymetry(double *sTrue, int *n, double xa, double xb, double ya, dou
             std::uniform_real_distribution<double> distribution(-sTrue[0] * perturbation / 100, sTrue[0] * perturbation / 100);
             for (int m = 0; m <= n[2]; m++)
             {
-                posFixed.push_back(x + distribution(generator));
-                posFixed.push_back(y + distribution(generator));
-                posFixed.push_back(z - ((double)m) * sTrue[2] + distribution(generator));
+                double xPert = x + distribution(generator);
+                double yPert = y + distribution(generator);
+                double zPert = z - ((double)m) * sTrue[2] + distribution(generator);
+                if (ownsPosition(xPert, yPert, zPert, region))
+                {
+                    posFixed.push_back(xPert);
+                    posFixed.push_back(yPert);
+                    posFixed.push_back(zPert);
+                }
             }
             int nzFree = std::max((int)round((hFreeSurface - z) / sTrue[2]), 0); //round because it is allowed to go a bit up of the free surface !
 
             for (int p = 1; p <= nzFree; p++)
             {
-                posFree.push_back(x + distribution(generator));
-                posFree.push_back(y + distribution(generator));
-                posFree.push_back(z + ((double)p) * sTrue[2] + distribution(generator));
+                double xPert = x + distribution(generator);
+                double yPert = y + distribution(generator);
+                double zPert = z + ((double)p) * sTrue[2] + distribution(generator);
+                if (ownsPosition(xPert, yPert, zPert, region))
+                {
+                    posFree.push_back(xPert);
+                    posFree.push_back(yPert);
+                    posFree.push_back(zPert);
+                    nFreeTotal++;
+                }
             }
-            nFreeTotal += nzFree;
         }
     }
     return nFreeTotal;
@@ -391,7 +409,7 @@ int interpBathymetry(double *sTrue, int *n, double xa, double xb, double ya, dou
 Error meshBathymetry(char *batFile, int bathType, int numberGroundParticles, double height0,
                      double hFreeSurface, double s, std::vector<double> &posFree,
                      std::vector<double> &posFixed, int *nPartFree, int *nPartFixed,
-                     double *volPart, double perturbation, bool stack)
+                     double *volPart, double perturbation, bool stack, SubdomainInfo *region)
 {
 
     double *bath;
@@ -484,11 +502,15 @@ Error meshBathymetry(char *batFile, int bathType, int numberGroundParticles, dou
     *volPart = sTrue[0] * sTrue[1] * sTrue[2];
     *nPartFixed = (n[0] + 1) * (n[1] + 1) * (n[2] + 1);
 
-    // memory allocation
-    posFixed.reserve(posFixed.size() + *nPartFixed * 3);
+    // memory allocation (unknown size if only the particles of a region are kept)
+    if (region == NULL)
+        posFixed.reserve(posFixed.size() + *nPartFixed * 3);
+    int nStartFixed = posFixed.size() / 3;
     // Impossible to know the posFree size at this point
 
-    *nPartFree = interpBathymetry(sTrue, n, xa, xb, ya, yb, height0, hFreeSurface, Nx, Ny, bath, posFree, posFixed, perturbation);
+    *nPartFree = interpBathymetry(sTrue, n, xa, xb, ya, yb, height0, hFreeSurface, Nx, Ny, bath, posFree, posFixed, perturbation,
+                                  region);
+    *nPartFixed = posFixed.size() / 3 - nStartFixed;
     free(bath);
 
     return noError;
@@ -31,10 +31,11 @@ void speedInit(Field *field, Parameter *parameter)
 *Input:
 *- field: field whose densities will be initialised
 *- parameter: pointer the the structure containing parameters
+*- comm: processes sharing the free surface height (each one holding a part of the field)
 *Decscription:
 *Initialise densities from field.
 */
-void densityInit(Field *field, Parameter *parameter)
+void densityInit(Field *field, Parameter *parameter, MPI_Comm comm)
 {
 	//Parameter withdrawal
 	double rho_0 = parameter->densityRef;
@@ -56,6 +57,7 @@ void densityInit(Field *field, Parameter *parameter)
 				zMax = field->pos[2][j];
 			}
 		}
+		MPI_Allreduce(MPI_IN_PLACE, &zMax, 1, MPI_DOUBLE, MPI_MAX, comm);
 		switch (parameter->stateEquationMethod)
 		{
 		case quasiIncompressible:
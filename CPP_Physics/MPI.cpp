@@ -8,33 +8,19 @@
 #include "Structures.h"
 
 // For particle exchange/sharing
-enum overlap
-{
-    leftOverlap,
-    noOverlap,
-    rightOverlap,
-    NB_OVERLAP_VALUE
-};
-enum migrate
-{
-    noMigrate,
-    leftMigrate,
-    rightMigrate,
-    NB_MIGRATE_VALUE
-};
 enum mpiMessage
 {
     overlap,
     migration,
-    dataExch,
-    RK2Exch,
+    haloUpdate,
     NB_MPIMESSAGE_VALUE
 };
-enum insertion
-{
-    begin,
-    end
-};
+
+// Values sent for each particle: pos (3), speed (3), density, mass, type (the pressure is recomputed)
+const int nPackedValues = 9;
+// Values sent to update the halos (RK2 midpoint, lazy migration): pos (3), speed (3), density
+// (mass and type of the halos do not change)
+const int nUpdateValues = 7;
 
 /*
 Input:
@@ -42,104 +28,42 @@ Input:
     - localField: partial field specific to each process. Will contain
     both the domain to be solved and the halos. Need to be done in two
     steps because MPI_Scatterv does not allow overlaps.
-    - parameter: to get kh and integrationMethod
+    - parameter: to get kh, integrationMethod and decomposition
 Ouput:
     - errorFlag: tells if the number of processor was acceptable or not
 */
 Error scatterField(Field *globalField, Field *localField, Parameter *parameter,
                    SubdomainInfo &subdomainInfo)
 {
-    // Error flag
-    Error errorFlag = noError;
-
     // Basic MPI process information
     int nTasks = subdomainInfo.nTasks;
     int procID = subdomainInfo.procID;
 
-    // Box size (bigger if RK2 to avoid sorting twice at each time step)
-    double boxSize = boxSizeCalc(parameter->kh, parameter->integrationMethod);
-    subdomainInfo.boxSize = boxSize;
-
-    // Checks if the number of processor appropriate (only node 0 has the info)
-    int nTotalBoxesX;
+    // Broadcasts the global l and u and cuts the domain in subdomains
     if (procID == 0)
     {
         for (int i = 0; i < 3; i++)
         {
-            localField->l[i] = globalField->l[i]; // x component will be changed
-            localField->u[i] = globalField->u[i]; // x component will be changed
-        }
-        nTotalBoxesX = ceil((globalField->u[0] - globalField->l[0]) / boxSize);
-        if (nTotalBoxesX < 2 * nTasks)
-        {
-            std::cout << "Too much processors for the domain" << std::endl;
-            std::cout << "The size along x must be sufficient to contain at least 2*nTasks boxes." << std::endl;
-            errorFlag = consistencyError;
+            localField->l[i] = globalField->l[i]; // will be changed by subdomainBounds
+            localField->u[i] = globalField->u[i]; // will be changed by subdomainBounds
         }
-        else
-        {
-            std::cout << "Appropriate number of processors" << std::endl;
-        }
-    }
-    MPI_Bcast(&errorFlag, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    if (errorFlag != noError)
-    {
-        return errorFlag;
     }
-
-    // Broadcasts the total number of boxes along x
-    MPI_Bcast(&nTotalBoxesX, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    std::vector<int> startBoxX(nTasks + 1); // The last element helps the last process
-    for (int i = 0; i <= nTasks; i++)
-    {
-        startBoxX[i] = (nTotalBoxesX * i) / nTasks; // can be optimized
-    }
-
-    // Broadcasts the global l and u and determines the correct l[0] and u[0]
     MPI_Bcast(localField->l, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
     MPI_Bcast(localField->u, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    double globall0 = localField->l[0];
-
-    // Number of boxes along the Y and Z directions
-    int nBoxesY = ceil((localField->u[1] - localField->l[1]) / boxSize);
-    int nBoxesZ = ceil((localField->u[2] - localField->l[2]) / boxSize);
-
-    // Left boundary and starting box
-    if (procID == 0)
-    {
-        localField->l[0] = globall0;
-        subdomainInfo.startingBox = 0;
-    }
-    else
-    {
-        localField->l[0] = globall0 + (startBoxX[procID] - 1) * boxSize;
-        subdomainInfo.startingBox = nBoxesY * nBoxesZ;
-    }
-
-    // Right boundary and ending box
-    if (procID == nTasks - 1)
-    {
-        localField->u[0] = globall0 + startBoxX[procID + 1] * boxSize;
-        subdomainInfo.endingBox = subdomainInfo.startingBox + (startBoxX[procID + 1] - startBoxX[procID]) * nBoxesY * nBoxesZ - 1;
-    }
-    else
+    Error errorFlag = initDecomposition(*localField, parameter, subdomainInfo);
+    if (errorFlag != noError)
     {
-        localField->u[0] = globall0 + (startBoxX[procID + 1] + 1) * boxSize;
-        subdomainInfo.endingBox = subdomainInfo.startingBox + (startBoxX[procID + 1] - startBoxX[procID]) * nBoxesY * nBoxesZ - 1;
+        return errorFlag;
     }
 
     // Computes indices and sorts particles
     std::vector<int> nPartNode(nTasks, 0);
     std::vector<std::pair<int, int>> domainIndex;
-    std::vector<double> limits(nTasks); // left boundary of each domain along x
     std::vector<int> offset(nTasks);
 
     if (procID == 0)
     {
-        for (int i = 0; i < nTasks; i++)
-            limits[i] = globall0 + startBoxX[i] * boxSize; // Without overlap
-        computeDomainIndex(globalField->pos[0], limits, nPartNode, domainIndex, nTasks);
+        computeDomainIndex(*globalField, subdomainInfo, nPartNode, domainIndex);
         sortParticles(*globalField, domainIndex);
         // Offset vector
         offset[0] = 0;
@@ -151,61 +75,27 @@ Error scatterField(Field *globalField, Field *localField, Parameter *parameter,
 
     // Shares the number of particle per domain and prepares the vector size
     MPI_Scatter(&nPartNode[0], 1, MPI_INT, &localField->nTotal, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    for (int i = 0; i < 3; i++)
-    {
-        localField->pos[i].resize(localField->nTotal);
-        localField->speed[i].resize(localField->nTotal);
-    }
-    localField->density.resize(localField->nTotal);
-    localField->pressure.resize(localField->nTotal);
-    localField->mass.resize(localField->nTotal);
-    localField->type.resize(localField->nTotal);
+    sizeField(*localField, localField->nTotal);
 
     // Scatters globalField into localFields
     for (int i = 0; i < 3; i++)
     {
-        MPI_Scatterv(&(globalField->pos[i][0]), &nPartNode[0], &offset[0], MPI_DOUBLE,
-                     &(localField->pos[i][0]), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-        MPI_Scatterv(&globalField->speed[i][0], &nPartNode[0], &offset[0], MPI_DOUBLE,
-                     &localField->speed[i][0], localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(globalField->pos[i].data(), &nPartNode[0], &offset[0], MPI_DOUBLE,
+                     localField->pos[i].data(), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(globalField->speed[i].data(), &nPartNode[0], &offset[0], MPI_DOUBLE,
+                     localField->speed[i].data(), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
     }
-    MPI_Scatterv(&(globalField->density[0]), &nPartNode[0], &offset[0], MPI_DOUBLE,
-                 &(localField->density[0]), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(&globalField->pressure[0], &nPartNode[0], &offset[0], MPI_DOUBLE,
-                 &localField->pressure[0], localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(&globalField->mass[0], &nPartNode[0], &offset[0], MPI_DOUBLE,
-                 &localField->mass[0], localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(&(globalField->type[0]), &nPartNode[0], &offset[0], MPI_INT,
-                 &(localField->type[0]), localField->nTotal, MPI_INT, 0, MPI_COMM_WORLD);
-
-    std::cout << localField->pos[0].size() << " particles on node " << procID << std::endl;
-
-    // Sharing boundaries
-    shareOverlap(*localField, subdomainInfo);
-
-    // Computes nTotal
-    localField->nTotal = localField->pos[0].size();
-
-    // Computes nFree, nMoving and nFixed
-    localField->nFree = 0;
-    localField->nFixed = 0;
-    localField->nMoving = 0;
-    for (int i = 0; i < localField->nTotal; i++)
-    {
-        switch (localField->type[i])
-        {
-        case freePart:
-            localField->nFree++;
-            break;
-        case fixedPart:
-            localField->nFixed++;
-            break;
-        default:
-            localField->nMoving++;
-        }
-    }
-
-    std::cout << localField->nTotal << " total particles on node " << procID << std::endl;
+    MPI_Scatterv(globalField->density.data(), &nPartNode[0], &offset[0], MPI_DOUBLE,
+                 localField->density.data(), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(globalField->pressure.data(), &nPartNode[0], &offset[0], MPI_DOUBLE,
+                 localField->pressure.data(), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(globalField->mass.data(), &nPartNode[0], &offset[0], MPI_DOUBLE,
+                 localField->mass.data(), localField->nTotal, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(globalField->type.data(), &nPartNode[0], &offset[0], MPI_INT,
+                 localField->type.data(), localField->nTotal, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // Halos and particle counts
+    setupLocalField(*localField, parameter, subdomainInfo);
 
     // Shares the moving boundaries information
     int nbMB1;
@@ -241,18 +131,516 @@ Error scatterField(Field *globalField, Field *localField, Parameter *parameter,
     return noError;
 }
 
-/* Gathers all the current fields into the global Field */
-void gatherField(Field *globalField, Field *localField, SubdomainInfo &subdomainInfo)
+/*
+Input:
+    - field: its l and u are the bounds of the global domain
+    - parameter: to get kh, integrationMethod, decomposition and haloSkin
+Ouput:
+    - errorFlag: tells if the number of processor was acceptable or not
+Description:
+    Builds the global mesh of boxes and cuts it in subdomains with the same
+    number of boxes (moved afterwards by balanceLoad if requested). Called by
+    all the processes, before the particles are distributed.
+*/
+Error initDecomposition(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    Error errorFlag = noError;
+
+    // Box size (bigger if RK2 to avoid sorting twice at each time step)
+    double boxSize = boxSizeCalc(parameter->kh, parameter->integrationMethod);
+    subdomainInfo.boxSize = boxSize;
+    subdomainInfo.haloDepth = 1 + parameter->haloSkin;
+
+    // Global mesh of boxes
+    for (int i = 0; i < 3; i++)
+    {
+        subdomainInfo.globalL[i] = field.l[i];
+        subdomainInfo.nTotalBoxes[i] = ceil((field.u[i] - field.l[i]) / boxSize);
+    }
+
+    // Same number of boxes per subdomain
+    std::vector<double> uniformLoad;
+    decomposeDomain(uniformLoad, parameter, subdomainInfo);
+
+    // Checks if the number of processor appropriate (each subdomain needs one box at least)
+    if (subdomainInfo.procID == 0)
+    {
+        for (int i = 0; i < subdomainInfo.nTasks && errorFlag == noError; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                if (subdomainInfo.subdomainBoxes[6 * i + 3 + j] <= subdomainInfo.subdomainBoxes[6 * i + j])
+                    errorFlag = consistencyError;
+            }
+        }
+        if (errorFlag != noError)
+        {
+            std::cout << "Too much processors for the domain" << std::endl;
+            std::cout << "The domain must be sufficient to contain at least one box per process";
+            std::cout << ((parameter->decomposition == slabs) ? " along x." : ".") << std::endl;
+        }
+        else
+        {
+            std::cout << "Appropriate number of processors" << std::endl;
+        }
+    }
+    MPI_Bcast(&errorFlag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    return errorFlag;
+}
+
+/*
+Input:
+    - localField: the particles of the subdomain (bounds of the global domain)
+    - parameter: pointer to the structure containing parameters
+Description:
+    Restricts the bounds of the local field to the subdomain and its halo,
+    receives the halos from the neighbors and counts the particles.
+*/
+void setupLocalField(Field &localField, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    int procID = subdomainInfo.procID;
+    subdomainBounds(localField, subdomainInfo);
+
+    std::cout << localField.pos[0].size() << " particles on node " << procID << std::endl;
+
+    // Sharing boundaries
+    shareOverlap(localField, parameter, subdomainInfo);
+
+    // Computes nTotal, nFree, nMoving and nFixed
+    countParticles(localField);
+
+    std::cout << localField.nTotal << " total particles on node " << procID << std::endl;
+}
+
+
+/*
+Input:
+    - a, b: processes [a, b[ sharing the region [lo, hi[ of the global mesh of boxes
+    - boxLoad: load of each box of the global mesh (uniform if empty)
+    - method: slabs (cuts along x only) or bisection (cuts along the longest direction)
+Description:
+    Recursive bisection of the region. The processes are split in [a, mid[ and
+    [mid, b[ with mid = (a+b)/2, and the region is cut so that both parts get a
+    load proportional to their number of processes. Each part keeps one box per
+    process at least. The cut is stored in cutAxis[mid] and cutBox[mid], and
+    the boxes of each subdomain in subdomainBoxes.
+*/
+void bisectDomain(int a, int b, int lo[3], int hi[3], std::vector<double> &boxLoad,
+                  DecompositionMethod method, SubdomainInfo &subdomainInfo)
+{
+    // A single process gets the whole region
+    if (b - a == 1)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            subdomainInfo.subdomainBoxes[6 * a + i] = lo[i];
+            subdomainInfo.subdomainBoxes[6 * a + 3 + i] = hi[i];
+        }
+        return;
+    }
+    int mid = (a + b) / 2;
+    int *nBoxes = subdomainInfo.nTotalBoxes;
+
+    // Cut direction
+    int axis = 0;
+    if (method == bisection)
+    {
+        for (int i = 1; i < 3; i++)
+            if (hi[i] - lo[i] > hi[axis] - lo[axis])
+                axis = i;
+    }
+    int axis1 = (axis + 1) % 3;
+    int axis2 = (axis + 2) % 3;
+    int area = (hi[axis1] - lo[axis1]) * (hi[axis2] - lo[axis2]); // boxes per slice
+
+    // cumulLoad[i]: load of the first i slices of boxes along the cut direction
+    int nSlices = hi[axis] - lo[axis];
+    std::vector<double> cumulLoad(nSlices + 1, 0.0);
+    if (!boxLoad.empty())
+    {
+        int box[3];
+        for (int i = 0; i < nSlices; i++)
+        {
+            double sliceLoad = 0.0;
+            box[axis] = lo[axis] + i;
+            for (box[axis1] = lo[axis1]; box[axis1] < hi[axis1]; box[axis1]++)
+                for (box[axis2] = lo[axis2]; box[axis2] < hi[axis2]; box[axis2]++)
+                    sliceLoad += boxLoad[box[2] + box[1] * nBoxes[2] + box[0] * nBoxes[2] * nBoxes[1]];
+            cumulLoad[i + 1] = cumulLoad[i] + sliceLoad;
+        }
+    }
+    if (cumulLoad[nSlices] <= 0.0) // no load at all: same number of boxes
+    {
+        for (int i = 0; i <= nSlices; i++)
+            cumulLoad[i] = i;
+    }
+
+    // Cuts where the cumulated load is the closest to the share of [a, mid[
+    double target = cumulLoad[nSlices] * (mid - a) / (b - a);
+    int cut = 0;
+    while (cut < nSlices && cumulLoad[cut] < target)
+        cut++;
+    if (cut > 0 && target - cumulLoad[cut - 1] < cumulLoad[cut] - target)
+        cut--;
+
+    // One box per process at least (one slice per process for slabs)
+    int perSlice = (method == slabs) ? 1 : area;
+    int minCut = (mid - a + perSlice - 1) / perSlice;
+    int maxCut = nSlices - (b - mid + perSlice - 1) / perSlice;
+    cut = std::max(std::min(cut, maxCut), minCut);
+
+    subdomainInfo.cutAxis[mid] = axis;
+    subdomainInfo.cutBox[mid] = lo[axis] + cut;
+
+    // Bisects both parts
+    int hiLower[3] = {hi[0], hi[1], hi[2]};
+    int loUpper[3] = {lo[0], lo[1], lo[2]};
+    hiLower[axis] = lo[axis] + cut;
+    loUpper[axis] = lo[axis] + cut;
+    bisectDomain(a, mid, lo, hiLower, boxLoad, method, subdomainInfo);
+    bisectDomain(mid, b, loUpper, hi, boxLoad, method, subdomainInfo);
+}
+
+/*
+Input:
+    - boxLoad: load of each box of the global mesh, on node 0 (uniform if empty)
+    - parameter: to get the decomposition method
+Description:
+    Splits the global mesh of boxes into one subdomain per process (node 0)
+    and broadcasts the result to all processes.
+*/
+void decomposeDomain(std::vector<double> &boxLoad, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    int nTasks = subdomainInfo.nTasks;
+    subdomainInfo.cutAxis.assign(nTasks, 0);
+    subdomainInfo.cutBox.assign(nTasks, 0);
+    subdomainInfo.subdomainBoxes.assign(6 * nTasks, 0);
+    if (subdomainInfo.procID == 0)
+    {
+        int lo[3] = {0, 0, 0};
+        bisectDomain(0, nTasks, lo, subdomainInfo.nTotalBoxes, boxLoad, parameter->decomposition, subdomainInfo);
+    }
+    MPI_Bcast(&subdomainInfo.cutAxis[0], nTasks, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&subdomainInfo.cutBox[0], nTasks, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&subdomainInfo.subdomainBoxes[0], 6 * nTasks, MPI_INT, 0, MPI_COMM_WORLD);
+}
+
+/*
+Input:
+    - localField: its l and u are set to the bounds of the subdomain (halos included)
+    - subdomainInfo: subdomainBoxes gives the boxes of each subdomain
+Description:
+    Sets the bounds of the local field: the subdomain extended by haloDepth
+    layers of boxes (the halo) except along the boundaries of the global
+    domain. The neighbors are the processes whose subdomain touches this halo.
+*/
+void subdomainBounds(Field &localField, SubdomainInfo &subdomainInfo)
+{
+    int procID = subdomainInfo.procID;
+    int nTasks = subdomainInfo.nTasks;
+    double boxSize = subdomainInfo.boxSize;
+    int *lo = &subdomainInfo.subdomainBoxes[6 * procID];
+    int *hi = lo + 3;
+
+    int haloLo[3], haloHi[3];
+    for (int i = 0; i < 3; i++)
+    {
+        haloLo[i] = std::max(lo[i] - subdomainInfo.haloDepth, 0);
+        haloHi[i] = std::min(hi[i] + subdomainInfo.haloDepth, subdomainInfo.nTotalBoxes[i]);
+        localField.l[i] = subdomainInfo.globalL[i] + haloLo[i] * boxSize;
+        localField.u[i] = subdomainInfo.globalL[i] + haloHi[i] * boxSize;
+    }
+
+    // Neighboring subdomains (sorted by procID)
+    subdomainInfo.neighbors.clear();
+    for (int proc = 0; proc < nTasks; proc++)
+    {
+        int *procLo = &subdomainInfo.subdomainBoxes[6 * proc];
+        int *procHi = procLo + 3;
+        bool touches = (proc != procID);
+        for (int i = 0; i < 3 && touches; i++)
+            touches = (procLo[i] < haloHi[i] && procHi[i] > haloLo[i]);
+        if (touches)
+            subdomainInfo.neighbors.push_back(proc);
+    }
+}
+
+// Gives the box of the global mesh containing a position (the border boxes also contain the positions out of the domain)
+void positionBox(double pos[3], SubdomainInfo &subdomainInfo, int box[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        double temp = (pos[i] - subdomainInfo.globalL[i]) / subdomainInfo.boxSize;
+        int nBoxes = subdomainInfo.nTotalBoxes[i];
+        box[i] = (temp < 0) ? 0 : ((temp < nBoxes - 1) ? (int)temp : nBoxes - 1);
+    }
+}
+
+// Gives the box of the global mesh containing a particle
+void globalBox(Field &field, int particleID, SubdomainInfo &subdomainInfo, int box[3])
+{
+    double pos[3] = {field.pos[0][particleID], field.pos[1][particleID], field.pos[2][particleID]};
+    positionBox(pos, subdomainInfo, box);
+}
+
+// Tells if a generated particle belongs to the subdomain of the process (always true without a region)
+bool ownsPosition(double x, double y, double z, SubdomainInfo *region)
+{
+    if (region == NULL)
+        return true;
+    double pos[3] = {x, y, z};
+    int box[3];
+    positionBox(pos, *region, box);
+    return getDomainNumber(box, *region) == region->procID;
+}
+
+// Gives the process owning a box of the global mesh (descends the bisection tree)
+int getDomainNumber(int box[3], SubdomainInfo &subdomainInfo)
+{
+    int a = 0;
+    int b = subdomainInfo.nTasks;
+    while (b - a > 1)
+    {
+        int mid = (a + b) / 2;
+        if (box[subdomainInfo.cutAxis[mid]] < subdomainInfo.cutBox[mid])
+            b = mid;
+        else
+            a = mid;
+    }
+    return a;
+}
+
+// Gives the position of a process in the neighbor list (-1 if it is not a neighbor)
+int getNeighborNumber(int proc, SubdomainInfo &subdomainInfo)
+{
+    std::vector<int> &neighbors = subdomainInfo.neighbors;
+    std::vector<int>::iterator it = std::lower_bound(neighbors.begin(), neighbors.end(), proc);
+    if (it == neighbors.end() || *it != proc)
+        return -1;
+    return it - neighbors.begin();
+}
+
+/* Computes nTotal, nFree, nFixed and nMoving of a field (halos included) */
+void countParticles(Field &field)
+{
+    field.nTotal = field.pos[0].size();
+    field.nFree = 0;
+    field.nFixed = 0;
+    field.nMoving = 0;
+    for (int i = 0; i < field.nTotal; i++)
+    {
+        switch (field.type[i])
+        {
+        case freePart:
+            field.nFree++;
+            break;
+        case fixedPart:
+            field.nFixed++;
+            break;
+        default:
+            field.nMoving++;
+        }
+    }
+}
+
+// Exchanges one vector with all the processes and replaces it by the received values
+template <typename T>
+void MPI_Alltoallv_Vector(std::vector<T> &vect, MPI_Datatype datatype,
+                          std::vector<int> &nSend, std::vector<int> &sendOffset,
+                          std::vector<int> &nRecv, std::vector<int> &recvOffset, int nNew)
+{
+    std::vector<T> recvVect(nNew);
+    MPI_Alltoallv(vect.data(), &nSend[0], &sendOffset[0], datatype,
+                  recvVect.data(), &nRecv[0], &recvOffset[0], datatype, MPI_COMM_WORLD);
+    vect.swap(recvVect);
+}
+
+/*
+Input:
+    - field: local field WITHOUT halos
+    - subdomainInfo: the (new) subdomains
+Description:
+    Sends every particle to the process whose subdomain contains it, whatever
+    the distance between the two subdomains (used when the subdomains move).
+*/
+void redistributeParticles(Field &field, SubdomainInfo &subdomainInfo)
+{
+    int nTasks = subdomainInfo.nTasks;
+
+    // Sorts the particles by destination
+    std::vector<int> nSend(nTasks, 0);
+    std::vector<std::pair<int, int>> domainIndex;
+    computeDomainIndex(field, subdomainInfo, nSend, domainIndex);
+    sortParticles(field, domainIndex);
+
+    // Shares the number of particles to exchange
+    std::vector<int> nRecv(nTasks);
+    MPI_Alltoall(&nSend[0], 1, MPI_INT, &nRecv[0], 1, MPI_INT, MPI_COMM_WORLD);
+    std::vector<int> sendOffset(nTasks, 0);
+    std::vector<int> recvOffset(nTasks, 0);
+    for (int i = 1; i < nTasks; i++)
+    {
+        sendOffset[i] = sendOffset[i - 1] + nSend[i - 1];
+        recvOffset[i] = recvOffset[i - 1] + nRecv[i - 1];
+    }
+    int nNew = recvOffset[nTasks - 1] + nRecv[nTasks - 1];
+
+    // Exchanges all the fields
+    for (int i = 0; i < 3; i++)
+    {
+        MPI_Alltoallv_Vector(field.pos[i], MPI_DOUBLE, nSend, sendOffset, nRecv, recvOffset, nNew);
+        MPI_Alltoallv_Vector(field.speed[i], MPI_DOUBLE, nSend, sendOffset, nRecv, recvOffset, nNew);
+    }
+    MPI_Alltoallv_Vector(field.density, MPI_DOUBLE, nSend, sendOffset, nRecv, recvOffset, nNew);
+    MPI_Alltoallv_Vector(field.pressure, MPI_DOUBLE, nSend, sendOffset, nRecv, recvOffset, nNew);
+    MPI_Alltoallv_Vector(field.mass, MPI_DOUBLE, nSend, sendOffset, nRecv, recvOffset, nNew);
+    MPI_Alltoallv_Vector(field.type, MPI_INT, nSend, sendOffset, nRecv, recvOffset, nNew);
+}
+
+/*
+Input:
+    - localField: local field (with halos), just updated by processUpdate
+    - parameter: to get balanceTolerance, balanceMeasure and decomposition
+Output:
+    - true if the subdomains have moved (the box mesh must be rebuilt)
+Description:
+    Recomputes the subdomains so that all processes get the same load. The
+    load of each box is the number of particles it contains, weighted by the
+    compute time per particle of their process if balanceMeasure == computeTime.
+    The subdomains are kept as long as the imbalance (max/mean load - 1) stays
+    below balanceTolerance.
+*/
+bool balanceLoad(Field &localField, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    int nTasks = subdomainInfo.nTasks;
+    int procID = subdomainInfo.procID;
+    if (nTasks == 1)
+        return false;
+
+    int start = subdomainInfo.startingParticle;
+    int end = subdomainInfo.endingParticle;
+
+    // Load carried by one particle of this process (compute time is not known before the first step)
+    double weight = 1.0;
+    if (parameter->balanceMeasure == computeTime && subdomainInfo.computeTime > 0.0)
+        weight = subdomainInfo.computeTime / (end - start + 1);
+    subdomainInfo.computeTime = 0.0;
+
+    // Imbalance of the current subdomains (node 0)
+    double localLoad = weight * (end - start + 1);
+    std::vector<double> allLoads(nTasks);
+    MPI_Gather(&localLoad, 1, MPI_DOUBLE, &allLoads[0], 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    double maxLoad = 0.0;
+    double meanLoad = 0.0;
+    int rebalance = 0;
+    if (procID == 0)
+    {
+        for (int i = 0; i < nTasks; i++)
+        {
+            maxLoad = std::max(maxLoad, allLoads[i]);
+            meanLoad += allLoads[i] / nTasks;
+        }
+        rebalance = (meanLoad > 0.0 && maxLoad / meanLoad - 1.0 > parameter->balanceTolerance);
+    }
+    MPI_Bcast(&rebalance, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!rebalance)
+        return false;
+
+    // Load of each box of the global mesh (summed on node 0)
+    int *nBoxes = subdomainInfo.nTotalBoxes;
+    std::vector<double> localBoxLoad(nBoxes[0] * nBoxes[1] * nBoxes[2], 0.0);
+    std::vector<double> boxLoad(localBoxLoad.size(), 0.0);
+    int box[3];
+    for (int i = start; i <= end; i++)
+    {
+        globalBox(localField, i, subdomainInfo, box);
+        localBoxLoad[box[2] + box[1] * nBoxes[2] + box[0] * nBoxes[2] * nBoxes[1]] += weight;
+    }
+    MPI_Reduce(&localBoxLoad[0], &boxLoad[0], boxLoad.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // New subdomains, kept only if they are better
+    std::vector<int> oldCutAxis(subdomainInfo.cutAxis);
+    std::vector<int> oldCutBox(subdomainInfo.cutBox);
+    std::vector<int> oldSubdomainBoxes(subdomainInfo.subdomainBoxes);
+    decomposeDomain(boxLoad, parameter, subdomainInfo);
+    int better = 0;
+    if (procID == 0)
+    {
+        double newMaxLoad = 0.0;
+        for (int proc = 0; proc < nTasks; proc++)
+        {
+            int *lo = &subdomainInfo.subdomainBoxes[6 * proc];
+            int *hi = lo + 3;
+            double load = 0.0;
+            for (box[0] = lo[0]; box[0] < hi[0]; box[0]++)
+                for (box[1] = lo[1]; box[1] < hi[1]; box[1]++)
+                    for (box[2] = lo[2]; box[2] < hi[2]; box[2]++)
+                        load += boxLoad[box[2] + box[1] * nBoxes[2] + box[0] * nBoxes[2] * nBoxes[1]];
+            newMaxLoad = std::max(newMaxLoad, load);
+        }
+        better = (newMaxLoad < maxLoad && subdomainInfo.subdomainBoxes != oldSubdomainBoxes);
+        if (better)
+            std::cout << "\nLoad balancing: imbalance " << maxLoad / meanLoad - 1.0
+                      << " -> " << newMaxLoad / meanLoad - 1.0 << std::endl;
+    }
+    MPI_Bcast(&better, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!better)
+    {
+        subdomainInfo.cutAxis.swap(oldCutAxis);
+        subdomainInfo.cutBox.swap(oldCutBox);
+        subdomainInfo.subdomainBoxes.swap(oldSubdomainBoxes);
+        return false;
+    }
+
+    // Moves the particles
+    deleteHalos(localField, subdomainInfo);
+    subdomainBounds(localField, subdomainInfo);
+    redistributeParticles(localField, subdomainInfo);
+    shareOverlap(localField, parameter, subdomainInfo);
+    countParticles(localField);
+    return true;
+}
+
+/* Gathers all the current fields (or only the listed particles of each one, with their normal if
+   normals is set on every process) into the global Field */
+void gatherField(Field *globalField, Field *localField, SubdomainInfo &subdomainInfo,
+                 std::vector<int> const *particles, bool normals)
 {
     // Gathers the number of particles for each node in node 0
     int nbPart = subdomainInfo.endingParticle - subdomainInfo.startingParticle + 1;
     int start = subdomainInfo.startingParticle;
+
+    // The listed particles are packed first
+    Field packed;
+    if (particles != NULL)
+    {
+        nbPart = particles->size();
+        start = 0;
+        sizeField(packed, nbPart);
+        for (int j = 0; j < nbPart; j++)
+        {
+            int i = (*particles)[j];
+            for (int coord = 0; coord < 3; coord++)
+            {
+                packed.pos[coord][j] = localField->pos[coord][i];
+                packed.speed[coord][j] = localField->speed[coord][i];
+            }
+            packed.density[j] = localField->density[i];
+            packed.pressure[j] = localField->pressure[i];
+            packed.mass[j] = localField->mass[i];
+            packed.type[j] = localField->type[i];
+            for (int coord = 0; coord < 3 && normals; coord++)
+                packed.normal[coord].push_back(localField->normal[coord][i]);
+        }
+        localField = &packed;
+    }
     std::vector<int> allNbPart;
     if (subdomainInfo.procID == 0)
         allNbPart.resize(subdomainInfo.nTasks);
     MPI_Gather(&nbPart, 1, MPI_INT, &(allNbPart[0]), 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    // Computes the offsets for scatterv
+    // Computes the offsets for scatterv and sizes the global field (never built
+    // on process 0 with the distributed initialization)
     std::vector<int> offsets;
     if (subdomainInfo.procID == 0)
     {
@@ -260,649 +648,470 @@ void gatherField(Field *globalField, Field *localField, SubdomainInfo &subdomain
         offsets[0] = 0;
         for (int i = 1; i < subdomainInfo.nTasks; i++)
             offsets[i] = offsets[i - 1] + allNbPart[i - 1];
+        sizeField(*globalField, offsets.back() + allNbPart.back());
     }
 
     // Gathers the fields
     for (int i = 0; i < 3; i++)
     {
-        MPI_Gatherv(&(localField->pos[i][start]), nbPart, MPI_DOUBLE,
-                    &(globalField->pos[i][0]), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
+        MPI_Gatherv(localField->pos[i].data() + start, nbPart, MPI_DOUBLE,
+                    globalField->pos[i].data(), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
                     0, MPI_COMM_WORLD);
-        MPI_Gatherv(&(localField->speed[i][start]), nbPart, MPI_DOUBLE,
-                    &(globalField->speed[i][0]), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
+        MPI_Gatherv(localField->speed[i].data() + start, nbPart, MPI_DOUBLE,
+                    globalField->speed[i].data(), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
                     0, MPI_COMM_WORLD);
     }
-    MPI_Gatherv(&(localField->density[start]), nbPart, MPI_DOUBLE,
-                &(globalField->density[0]), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
+    MPI_Gatherv(localField->density.data() + start, nbPart, MPI_DOUBLE,
+                globalField->density.data(), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
                 0, MPI_COMM_WORLD);
-    MPI_Gatherv(&(localField->pressure[start]), nbPart, MPI_DOUBLE,
-                &(globalField->pressure[0]), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
+    MPI_Gatherv(localField->pressure.data() + start, nbPart, MPI_DOUBLE,
+                globalField->pressure.data(), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
                 0, MPI_COMM_WORLD);
-    MPI_Gatherv(&(localField->mass[start]), nbPart, MPI_DOUBLE,
-                &(globalField->mass[0]), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
+    MPI_Gatherv(localField->mass.data() + start, nbPart, MPI_DOUBLE,
+                globalField->mass.data(), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
                 0, MPI_COMM_WORLD);
-    MPI_Gatherv(&(localField->type[start]), nbPart, MPI_INT,
-                &(globalField->type[0]), &(allNbPart[0]), &(offsets[0]), MPI_INT,
+    MPI_Gatherv(localField->type.data() + start, nbPart, MPI_INT,
+                globalField->type.data(), &(allNbPart[0]), &(offsets[0]), MPI_INT,
                 0, MPI_COMM_WORLD);
+    for (int i = 0; i < 3 && normals; i++)
+    {
+        if (subdomainInfo.procID == 0)
+            globalField->normal[i].resize(globalField->pos[i].size());
+        MPI_Gatherv(localField->normal[i].data() + start, nbPart, MPI_DOUBLE,
+                    globalField->normal[i].data(), &(allNbPart[0]), &(offsets[0]), MPI_DOUBLE,
+                    0, MPI_COMM_WORLD);
+    }
+    if (subdomainInfo.procID == 0)
+        countParticles(*globalField);
 }
 
+// The halos are at the end of the field: only the particles of the subdomain are kept
 void deleteHalos(Field &field, SubdomainInfo &subdomainInfo)
 {
-    // Starting and ending particles
-    int start = subdomainInfo.startingParticle;
-    int end = subdomainInfo.endingParticle;
+    sizeField(field, subdomainInfo.endingParticle + 1);
+}
 
-    // Deletes in all fields
-    for (int i = 0; i < 3; i++)
+// Copies the particles of a list (shifted by shift) at the end of a buffer (nValues per particle)
+void packParticles(Field &field, std::vector<int> &list, int shift, std::vector<double> &buffer, int nValues)
+{
+    int n = buffer.size();
+    buffer.resize(n + nValues * list.size());
+    double *packed = buffer.data() + n;
+    for (unsigned int j = 0; j < list.size(); j++)
     {
-        // Cut position
-        field.pos[i].resize(end + 1);
-        field.pos[i].erase(field.pos[i].begin(), field.pos[i].begin() + start);
-        // Cut speed
-        field.speed[i].resize(end + 1);
-        field.speed[i].erase(field.speed[i].begin(), field.speed[i].begin() + start);
+        int i = list[j] + shift;
+        for (int coord = 0; coord < 3; coord++)
+        {
+            packed[coord] = field.pos[coord][i];
+            packed[3 + coord] = field.speed[coord][i];
+        }
+        packed[6] = field.density[i];
+        if (nValues == nPackedValues)
+        {
+            packed[7] = field.mass[i];
+            packed[8] = field.type[i];
+        }
+        packed += nValues;
     }
-    // Cut density
-    field.density.resize(end + 1);
-    field.density.erase(field.density.begin(), field.density.begin() + start);
-    // Cut pressure
-    field.pressure.resize(end + 1);
-    field.pressure.erase(field.pressure.begin(), field.pressure.begin() + start);
-    // Cut mass
-    field.mass.resize(end + 1);
-    field.mass.erase(field.mass.begin(), field.mass.begin() + start);
-    // Cut type
-    field.type.resize(end + 1);
-    field.type.erase(field.type.begin(), field.type.begin() + start);
 }
 
-// Generalizes the MPI_Send function to all fields to send
-void MPI_Send_All(Field &field, int startingPoint, int size, int recvProcID, mpiMessage message)
+// Copies the n particles of a buffer into the field, from particle start, and computes their pressure
+void unpackParticles(std::vector<double> &buffer, int n, Field &field, int start, int nValues, Parameter *parameter)
 {
-    for (int i = 0; i < 3; i++)
+    const double *packed = buffer.data();
+    for (int i = start; i < start + n; i++)
     {
-        MPI_Send(&field.pos[i][startingPoint], size, MPI_DOUBLE, recvProcID, message, MPI_COMM_WORLD);
-        MPI_Send(&field.speed[i][startingPoint], size, MPI_DOUBLE, recvProcID, message, MPI_COMM_WORLD);
+        for (int coord = 0; coord < 3; coord++)
+        {
+            field.pos[coord][i] = packed[coord];
+            field.speed[coord][i] = packed[3 + coord];
+        }
+        field.density[i] = packed[6];
+        if (nValues == nPackedValues)
+        {
+            field.mass[i] = packed[7];
+            field.type[i] = (int)packed[8];
+        }
+        pressureComputation(&field, parameter, i);
+        packed += nValues;
     }
-    MPI_Send(&field.density[startingPoint], size, MPI_DOUBLE, recvProcID, message, MPI_COMM_WORLD);
-    MPI_Send(&field.pressure[startingPoint], size, MPI_DOUBLE, recvProcID, message, MPI_COMM_WORLD);
-    MPI_Send(&field.mass[startingPoint], size, MPI_DOUBLE, recvProcID, message, MPI_COMM_WORLD);
-    MPI_Send(&field.type[startingPoint], size, MPI_INT, recvProcID, message, MPI_COMM_WORLD);
 }
 
-// Generalizes the MPI_Receive function to all fields to receive
-void MPI_Recv_All(std::vector<double> (&recvBuffer)[9], std::vector<int> &recvBufferType,
-                  int size, int sendProcID, mpiMessage message)
+/*
+Input:
+    - sendBuffer: packed particles for each neighbor
+    - message: tag of the exchange
+Output:
+    - recvBuffer: packed particles received from each neighbor
+Description:
+    Exchanges one message per neighbor. The size of the received messages is
+    given by MPI_Probe, so no size message is needed.
+*/
+void exchangePacked(std::vector<std::vector<double>> &sendBuffer, std::vector<std::vector<double>> &recvBuffer,
+                    mpiMessage message, SubdomainInfo &subdomainInfo)
 {
-    // Elements: 0,x | 1,u | 2,y | 3,v | 4,z | 5,w | 6,density | 7,pressure | 8,mass
-    for (int i = 0; i < 9; i++)
+    int nNeighbors = subdomainInfo.neighbors.size();
+    std::vector<MPI_Request> requests(nNeighbors);
+    for (int k = 0; k < nNeighbors; k++)
     {
-        MPI_Recv(&recvBuffer[i][0], size, MPI_DOUBLE, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Isend(sendBuffer[k].data(), sendBuffer[k].size(), MPI_DOUBLE, subdomainInfo.neighbors[k],
+                  message, MPI_COMM_WORLD, &requests[k]);
     }
-    MPI_Recv(&recvBufferType[0], size, MPI_INT, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-}
 
-// Generalizes the MPI_Receive function in the case where we write directly in the field
-// Use: for sharing the mid-point information of RK2
-void MPI_Recv_All_RK2(Field &field, int startingPoint, int size, int sendProcID, mpiMessage message)
-{
-    for (int i = 0; i < 3; i++)
+    // Receives the messages in their order of arrival
+    recvBuffer.resize(nNeighbors);
+    for (int j = 0; j < nNeighbors; j++)
     {
-        MPI_Recv(&field.pos[i][startingPoint], size, MPI_DOUBLE, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(&field.speed[i][startingPoint], size, MPI_DOUBLE, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Status status;
+        int count;
+        MPI_Probe(MPI_ANY_SOURCE, message, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_DOUBLE, &count);
+        int k = getNeighborNumber(status.MPI_SOURCE, subdomainInfo);
+        recvBuffer[k].resize(count);
+        MPI_Recv(recvBuffer[k].data(), count, MPI_DOUBLE, status.MPI_SOURCE, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
     }
-    MPI_Recv(&field.density[startingPoint], size, MPI_DOUBLE, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(&field.pressure[startingPoint], size, MPI_DOUBLE, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(&field.mass[startingPoint], size, MPI_DOUBLE, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(&field.type[startingPoint], size, MPI_INT, sendProcID, message, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Waitall(nNeighbors, requests.data(), MPI_STATUSES_IGNORE);
 }
 
-void insertParticles(Field &field, std::vector<double> (&recvBuffer)[9], std::vector<int> &recvBufferType, insertion place)
+// Frees the persistent requests of the halo update
+void freeHaloRequests(SubdomainInfo &subdomainInfo)
 {
-    if (place == end)
-    { // Put it at the end
-        for (int i = 0; i < 3; i++)
-        {
-            field.pos[i].insert(field.pos[i].end(), recvBuffer[2 * i].begin(), recvBuffer[2 * i].end());
-            field.speed[i].insert(field.speed[i].end(), recvBuffer[2 * i + 1].begin(), recvBuffer[2 * i + 1].end());
-        }
-        field.density.insert(field.density.end(), recvBuffer[6].begin(), recvBuffer[6].end());
-        field.pressure.insert(field.pressure.end(), recvBuffer[7].begin(), recvBuffer[7].end());
-        field.mass.insert(field.mass.end(), recvBuffer[8].begin(), recvBuffer[8].end());
-        field.type.insert(field.type.end(), recvBufferType.begin(), recvBufferType.end());
-    }
-    else if (place == begin)
-    { // Put it at the beginning
-        for (int i = 0; i < 3; i++)
-        {
-            field.pos[i].insert(field.pos[i].begin(), recvBuffer[2 * i].begin(), recvBuffer[2 * i].end());
-            field.speed[i].insert(field.speed[i].begin(), recvBuffer[2 * i + 1].begin(), recvBuffer[2 * i + 1].end());
-        }
-        field.density.insert(field.density.begin(), recvBuffer[6].begin(), recvBuffer[6].end());
-        field.pressure.insert(field.pressure.begin(), recvBuffer[7].begin(), recvBuffer[7].end());
-        field.mass.insert(field.mass.begin(), recvBuffer[8].begin(), recvBuffer[8].end());
-        field.type.insert(field.type.begin(), recvBufferType.begin(), recvBufferType.end());
+    for (unsigned int i = 0; i < subdomainInfo.haloRequests.size(); i++)
+        MPI_Request_free(&subdomainInfo.haloRequests[i]);
+    subdomainInfo.haloRequests.clear();
+    subdomainInfo.haloCounts.clear();
+}
+
+/*
+Description:
+    Prepares the persistent requests of the halo update (one send and one
+    receive per neighbor). They are kept as long as the halos have
+    the same neighbors and sizes, otherwise they are created again.
+*/
+void initHaloRequests(SubdomainInfo &subdomainInfo)
+{
+    int nNeighbors = subdomainInfo.neighbors.size();
+    std::vector<int> counts(3 * nNeighbors);
+    for (int k = 0; k < nNeighbors; k++)
+    {
+        counts[3 * k] = subdomainInfo.neighbors[k];
+        counts[3 * k + 1] = subdomainInfo.haloSendList[k].size();
+        counts[3 * k + 2] = subdomainInfo.haloRecvCount[k];
     }
-    else
+    if (!subdomainInfo.haloRequests.empty() && counts == subdomainInfo.haloCounts)
+        return;
+
+    freeHaloRequests(subdomainInfo);
+    subdomainInfo.haloCounts = counts;
+    subdomainInfo.haloSendBuffer.resize(nNeighbors);
+    subdomainInfo.haloRecvBuffer.resize(nNeighbors);
+    subdomainInfo.haloRequests.resize(2 * nNeighbors);
+    for (int k = 0; k < nNeighbors; k++)
     {
-        std::cout << "Not acceptable insertion operation." << std::endl;
+        std::vector<double> &sendBuffer = subdomainInfo.haloSendBuffer[k];
+        std::vector<double> &recvBuffer = subdomainInfo.haloRecvBuffer[k];
+        sendBuffer.resize(nUpdateValues * counts[3 * k + 1]);
+        recvBuffer.resize(nUpdateValues * counts[3 * k + 2]);
+        MPI_Recv_init(recvBuffer.data(), recvBuffer.size(), MPI_DOUBLE, subdomainInfo.neighbors[k],
+                      haloUpdate, MPI_COMM_WORLD, &subdomainInfo.haloRequests[2 * k]);
+        MPI_Send_init(sendBuffer.data(), sendBuffer.size(), MPI_DOUBLE, subdomainInfo.neighbors[k],
+                      haloUpdate, MPI_COMM_WORLD, &subdomainInfo.haloRequests[2 * k + 1]);
     }
 }
 
-void shareRKMidpoint(Field &field, SubdomainInfo &subdomainInfo)
+/*
+Input:
+    - field: field whose halos must be updated (RK2 midpoint, or new time
+    step between two migrations if haloSkin > 0)
+Description:
+    Starts the update of the halos with the values computed by the
+    neighbors, without waiting for it: the inner particles can be computed in
+    the meantime (see derivativeComputation) and waitHalos completes it. The
+    halos keep the same particles, in the same order, as set by shareOverlap,
+    so only pos, speed and density are sent: mass and type are already in
+    the halos and the pressure is recomputed.
+*/
+void startHaloUpdate(Field &field, SubdomainInfo &subdomainInfo)
 {
-    // Useful information
-    int start = subdomainInfo.startingParticle;
-    int end = subdomainInfo.endingParticle;
-    int procID = subdomainInfo.procID;
-    int nTasks = subdomainInfo.nTasks;
-
-    // Declarations
-    int sizeToLeft;
-    int sizeToRight;
-    int sizeFromLeft = start;
-    int sizeFromRight = field.nTotal - end - 1;
+    int nNeighbors = subdomainInfo.neighbors.size();
+    if (nNeighbors == 0)
+        return;
 
-    // Different possible cases
-    if (nTasks > 1)
+    // Packs the edge particles sent to each neighbor in the persistent buffers
+    initHaloRequests(subdomainInfo);
+    for (int k = 0; k < nNeighbors; k++)
     {
-        if (procID == 0)
-        {
-            // Sends the edge to the right
-            MPI_Recv(&sizeToRight, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            MPI_Send_All(field, end - sizeToRight + 1, sizeToRight, procID + 1, RK2Exch);
-            // Nothing to send to the left
-
-            // Nothing to reveive from the left
-            // Receives the halo from the right
-            MPI_Send(&sizeFromRight, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-            MPI_Recv_All_RK2(field, end + 1, sizeFromRight, procID + 1, RK2Exch);
-        }
-        else if (procID == nTasks - 1)
-        {
-            if (procID % 2 == 0)
-            {
-                // Nothing to send to the right
-                // Sends the edge to the left (procID is even)
-                MPI_Recv(&sizeToLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send_All(field, start, sizeToLeft, procID - 1, RK2Exch);
-
-                // Receives the edge from the left (procID is even)
-                MPI_Send(&sizeFromLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Recv_All_RK2(field, 0, sizeFromLeft, procID - 1, RK2Exch);
-                // Nothing to receive from the right
-            }
-            else
-            {
-                // Receives the edge from the left (procID is odd)
-                MPI_Send(&sizeFromLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Recv_All_RK2(field, 0, sizeFromLeft, procID - 1, RK2Exch);
-                // Nothing to receive from the right
-
-                // Nothing to send to the right
-                // Sends the edge to the left (procID is odd)
-                MPI_Recv(&sizeToLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send_All(field, start, sizeToLeft, procID - 1, RK2Exch);
-            }
-        }
-        else
-        {
-            if (procID % 2 == 0)
-            {
-                // Sends the edge to the right (procID is even)
-                MPI_Recv(&sizeToRight, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send_All(field, end - sizeToRight + 1, sizeToRight, procID + 1, RK2Exch);
-                // Sends the edge to the left (procID is even)
-                MPI_Recv(&sizeToLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send_All(field, start, sizeToLeft, procID - 1, RK2Exch);
-
-                // Receives the edge from the left (procID is even)
-                MPI_Send(&sizeFromLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Recv_All_RK2(field, 0, sizeFromLeft, procID - 1, RK2Exch);
-                // Receives the edge from the right (procID is even)
-                MPI_Send(&sizeFromRight, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-                MPI_Recv_All_RK2(field, end + 1, sizeFromRight, procID + 1, RK2Exch);
-            }
-            else
-            {
-                // Receives the edge from the left (procID is odd)
-                MPI_Send(&sizeFromLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Recv_All_RK2(field, 0, sizeFromLeft, procID - 1, RK2Exch);
-                // Receives the edge from the right (procID is odd)
-                MPI_Send(&sizeFromRight, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-                MPI_Recv_All_RK2(field, end + 1, sizeFromRight, procID + 1, RK2Exch);
-
-                // Sends the edge to the right (procID is odd)
-                MPI_Recv(&sizeToRight, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send_All(field, end - sizeToRight + 1, sizeToRight, procID + 1, RK2Exch);
-                // Sends the edge to the left (procID is odd)
-                MPI_Recv(&sizeToLeft, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send_All(field, start, sizeToLeft, procID - 1, RK2Exch);
-            }
-        }
+        subdomainInfo.haloSendBuffer[k].clear(); // keeps the memory (and the persistent request) valid
+        packParticles(field, subdomainInfo.haloSendList[k], subdomainInfo.startingParticle,
+                      subdomainInfo.haloSendBuffer[k], nUpdateValues);
     }
-    else
-    {
+
+    MPI_Startall(subdomainInfo.haloRequests.size(), subdomainInfo.haloRequests.data());
+    subdomainInfo.haloPending = true;
+}
+
+/* Completes the pending halo exchange and copies the halos into the field (nothing to do if there is none) */
+void waitHalos(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    if (!subdomainInfo.haloPending)
         return;
+    MPI_Waitall(subdomainInfo.haloRequests.size(), subdomainInfo.haloRequests.data(), MPI_STATUSES_IGNORE);
+    for (unsigned int k = 0; k < subdomainInfo.neighbors.size(); k++)
+    {
+        unpackParticles(subdomainInfo.haloRecvBuffer[k], subdomainInfo.haloRecvCount[k], field,
+                        subdomainInfo.haloRecvStart[k], nUpdateValues, parameter);
     }
+    subdomainInfo.haloPending = false;
 }
 
-void shareOverlap(Field &field, SubdomainInfo &subdomainInfo)
+/*
+Input:
+    - field: local field WITHOUT halos
+Description:
+    Sends the edge particles to the neighbors whose halo contains them and
+    receives the halos, which are appended after the particles of the
+    subdomain (owned particles in [0, nOwned[, so startingParticle is always
+    0). Sets endingParticle and the halo lists used by startHaloUpdate.
+*/
+void shareOverlap(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo)
 {
-    // Declarations
-    std::vector<std::pair<int, int>> indexOverlap;
-    std::vector<double> recvVectL[9], recvVectR[9];
-    std::vector<int> recvVectTypeL, recvVectTypeR;
-    int nOverlap[2];
-    int startOverlapToRight; // startOverlapToLeft is always equal to 0 !!
-    int sizeRecvOverlapL, sizeRecvOverlapR;
-
-    // Useful information
-    double l0 = field.l[0];
-    double u0 = field.u[0];
-    double boxSize = subdomainInfo.boxSize;
-    int procID = subdomainInfo.procID;
-    int nTasks = subdomainInfo.nTasks;
+    int nNeighbors = subdomainInfo.neighbors.size();
+
+    // Edge particles sent to each neighbor
+    computeOverlapIndex(field, subdomainInfo, subdomainInfo.haloSendList);
 
-    // Different possible cases (trivial if only one node)
-    if (nTasks > 1)
+    // Packs and exchanges them
+    std::vector<std::vector<double>> &sendBuffer = subdomainInfo.sendBuffer;
+    std::vector<std::vector<double>> &recvBuffer = subdomainInfo.recvBuffer;
+    sendBuffer.resize(nNeighbors);
+    for (int k = 0; k < nNeighbors; k++)
     {
-        if (procID == 0)
-        { 
-            // No left neighbor domain
-            // inner domain: [l[0] , u[0] - 2*boxSize[
-            // right edge: [u[0] - 2*boxSize , u[0] - boxSize[
-            // right halo: [u[0] - boxSize , u[0]]
-            computeOverlapIndex(field.pos[0], indexOverlap, nOverlap,
-                                l0, l0, u0 - 2 * boxSize, u0 - boxSize); // No Left Overlap
-            sortParticles(field, indexOverlap);
-
-            // Start position to send
-            startOverlapToRight = field.pos[0].size() - nOverlap[1];
-
-            // Sends the edge to the right
-            MPI_Send(&nOverlap[1], 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-            MPI_Send_All(field, startOverlapToRight, nOverlap[1], procID + 1, overlap);
-
-            // Receives the halo from the right
-            MPI_Recv(&sizeRecvOverlapR, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            //recvVectR.resize(sizeRecvOverlapR);
-            for (int i = 0; i < 9; i++)
-            {
-                recvVectR[i].resize(sizeRecvOverlapR);
-            }
-            recvVectTypeR.resize(sizeRecvOverlapR);
-            MPI_Recv_All(recvVectR, recvVectTypeR, sizeRecvOverlapR, procID + 1, overlap);
+        sendBuffer[k].clear();
+        packParticles(field, subdomainInfo.haloSendList[k], 0, sendBuffer[k], nPackedValues);
+    }
+    exchangePacked(sendBuffer, recvBuffer, overlap, subdomainInfo);
+
+    // Position of each halo (after the particles of the subdomain)
+    int nOwned = field.pos[0].size();
+    int nTotal = nOwned;
+    subdomainInfo.haloRecvStart.resize(nNeighbors);
+    subdomainInfo.haloRecvCount.resize(nNeighbors);
+    for (int k = 0; k < nNeighbors; k++)
+    {
+        subdomainInfo.haloRecvStart[k] = nTotal;
+        subdomainInfo.haloRecvCount[k] = recvBuffer[k].size() / nPackedValues;
+        nTotal += subdomainInfo.haloRecvCount[k];
+    }
 
-            // Adding the particles to the field (at the end of the vector)
-            insertParticles(field, recvVectR, recvVectTypeR, end);
+    // Appends the halos
+    sizeField(field, nTotal);
+    for (int k = 0; k < nNeighbors; k++)
+    {
+        unpackParticles(recvBuffer[k], subdomainInfo.haloRecvCount[k], field, subdomainInfo.haloRecvStart[k],
+                        nPackedValues, parameter);
+    }
+    subdomainInfo.startingParticle = 0;
+    subdomainInfo.endingParticle = nOwned - 1;
 
-            // Update the starting/ending particles
-            subdomainInfo.startingParticle = 0;
-            subdomainInfo.endingParticle = field.pos[0].size() - sizeRecvOverlapR - 1;
-        }
-        else if (procID == nTasks - 1)
-        { 
-            // No right neighbor domain
-            // left halo: [l[0] , l[0] + boxSize[
-            // left edge: [l[0] + boxSize , l[0] + 2*boxSize[
-            // inner domain: [l[0] + 2*boxSize , u[0][
-            computeOverlapIndex(field.pos[0], indexOverlap, nOverlap,
-                                l0 + boxSize, l0 + 2 * boxSize, u0, u0); // No right Overlap
-            sortParticles(field, indexOverlap);
-
-            if (procID % 2 == 0)
-            {
-                // Nothing to send to the right
-                // Sends the edge to the left (procID is even)
-                MPI_Send(&nOverlap[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, 0, nOverlap[0], procID - 1, overlap);
-
-                // Receives the edge from the left (procID is even)
-                MPI_Recv(&sizeRecvOverlapL, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvOverlapL);
-                }
-                recvVectTypeL.resize(sizeRecvOverlapL);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvOverlapL, procID - 1, overlap);
-                // Nothing to receive from the right
-            }
-            else
-            {
-                // Receives the edge from the left (procID is odd)
-                MPI_Recv(&sizeRecvOverlapL, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvOverlapL);
-                }
-                recvVectTypeL.resize(sizeRecvOverlapL);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvOverlapL, procID - 1, overlap);
-                // Nothing to receive from the right
-
-                // Nothing to send to the right
-                // Sends the edge to the left (procID is odd)
-                MPI_Send(&nOverlap[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, 0, nOverlap[0], procID - 1, overlap);
-            }
+    // Reference positions for the lazy migration
+    if (subdomainInfo.haloDepth > 1)
+    {
+        for (int coord = 0; coord < 3; coord++)
+            subdomainInfo.skinPos[coord].assign(field.pos[coord].begin(), field.pos[coord].begin() + nOwned);
+    }
+}
 
-            // Adding the particles to the field
-            insertParticles(field, recvVectL, recvVectTypeL, begin);
+/*
+Output:
+    - true if a particle (of any process) has moved more than half the skin
+    since the last migration
+Description:
+    The skin is haloSkin*boxSize. While no particle has moved more than half
+    of it, a particle of the subdomain cannot come closer than kh to a particle
+    that was out of the halo at the last migration, so the halos stay valid.
+*/
+bool skinExceeded(Field &field, SubdomainInfo &subdomainInfo)
+{
+    double maxMove = 0.5 * (subdomainInfo.haloDepth - 1) * subdomainInfo.boxSize;
+    double maxMove2 = maxMove * maxMove;
+    int exceeded = 0;
+#pragma omp parallel for reduction(max : exceeded)
+    for (int i = 0; i <= subdomainInfo.endingParticle; i++)
+    {
+        double move2 = 0.0;
+        for (int coord = 0; coord < 3; coord++)
+            move2 += (field.pos[coord][i] - subdomainInfo.skinPos[coord][i]) * (field.pos[coord][i] - subdomainInfo.skinPos[coord][i]);
+        if (move2 > maxMove2)
+            exceeded = 1;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &exceeded, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    return exceeded;
+}
 
-            // Update the starting/ending particles
-            subdomainInfo.startingParticle = sizeRecvOverlapL;
-            subdomainInfo.endingParticle = field.pos[0].size() - 1;
+// Keeps only the particles of a list (sorted in increasing order)
+void keepParticles(Field &field, std::vector<int> &list)
+{
+    int n = list.size();
+    for (int j = 0; j < n; j++)
+    {
+        int i = list[j];
+        if (i == j)
+            continue;
+        for (int coord = 0; coord < 3; coord++)
+        {
+            field.pos[coord][j] = field.pos[coord][i];
+            field.speed[coord][j] = field.speed[coord][i];
         }
-        else
-        { 
-            // Domain in the middle
-            // left halo: [l[0] , l[0] + boxSize[
-            // left edge: [l[0] + boxSize , l[0] + 2*boxSize[
-            // inner domain: [l[0] + 2*boxSize , u[0] - 2*boxSize[
-            // right edge: [u[0] - 2*boxSize , u[0] - boxSize[
-            // right halo: [u[0] - boxSize , u[0]]
-            computeOverlapIndex(field.pos[0], indexOverlap, nOverlap,
-                                l0 + boxSize, l0 + 2 * boxSize, u0 - 2 * boxSize, u0 - boxSize);
-            sortParticles(field, indexOverlap);
-
-            // Start position to send
-            startOverlapToRight = field.pos[0].size() - nOverlap[1];
-
-            if (procID % 2 == 0)
-            {
-                // Sends the edge to the right (procID is even)
-                MPI_Send(&nOverlap[1], 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startOverlapToRight, nOverlap[1], procID + 1, overlap);
-                // Sends the edge to the left (procID is even)
-                MPI_Send(&nOverlap[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, 0, nOverlap[0], procID - 1, overlap);
-
-                // Receives the edge from the left (procID is even)
-                MPI_Recv(&sizeRecvOverlapL, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvOverlapL);
-                }
-                recvVectTypeL.resize(sizeRecvOverlapL);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvOverlapL, procID - 1, overlap);
-                // Receives the edge from the right (procID is even)
-                MPI_Recv(&sizeRecvOverlapR, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectR[i].resize(sizeRecvOverlapR);
-                }
-                recvVectTypeR.resize(sizeRecvOverlapR);
-                MPI_Recv_All(recvVectR, recvVectTypeR, sizeRecvOverlapR, procID + 1, overlap);
-
-                // Adding the particles to the field
-            }
-            else
-            {
-                // Receives the edge from the left (procID is even)
-                MPI_Recv(&sizeRecvOverlapL, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvOverlapL);
-                }
-                recvVectTypeL.resize(sizeRecvOverlapL);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvOverlapL, procID - 1, overlap);
-                // Receives the edge from the right (procID is even)
-                MPI_Recv(&sizeRecvOverlapR, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectR[i].resize(sizeRecvOverlapR);
-                }
-                recvVectTypeR.resize(sizeRecvOverlapR);
-                MPI_Recv_All(recvVectR, recvVectTypeR, sizeRecvOverlapR, procID + 1, overlap);
-
-                // Sends the edge to the right (procID is even)
-                MPI_Send(&nOverlap[1], 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startOverlapToRight, nOverlap[1], procID + 1, overlap);
-                // Sends the edge to the left (procID is even)
-                MPI_Send(&nOverlap[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, 0, nOverlap[0], procID - 1, overlap);
-            }
+        field.density[j] = field.density[i];
+        field.pressure[j] = field.pressure[i];
+        field.mass[j] = field.mass[i];
+        field.type[j] = field.type[i];
+    }
+    sizeField(field, n);
+}
 
-            // Adding the particles to the field
-            insertParticles(field, recvVectL, recvVectTypeL, begin);
-            insertParticles(field, recvVectR, recvVectTypeR, end);
+/*
+Input:
+    - farList: particles of the field whose new subdomain is not a neighbor
+Description:
+    Sends these particles directly to their new subdomain, whatever its
+    distance (sparse all-to-all: the counts are exchanged first) and appends
+    the particles received this way. Collective: called by all processes.
+*/
+void shareFarMigrate(Field &field, std::vector<int> &farList, Parameter *parameter, SubdomainInfo &subdomainInfo)
+{
+    int nTasks = subdomainInfo.nTasks;
 
-            // Update the starting/ending particles
-            subdomainInfo.startingParticle = sizeRecvOverlapL;
-            subdomainInfo.endingParticle = field.pos[0].size() - sizeRecvOverlapR - 1;
-        }
+    // Packs the particles by destination
+    std::vector<std::vector<int>> sendList(nTasks);
+    int box[3];
+    for (unsigned int j = 0; j < farList.size(); j++)
+    {
+        globalBox(field, farList[j], subdomainInfo, box);
+        sendList[getDomainNumber(box, subdomainInfo)].push_back(farList[j]);
     }
-    else
+    std::vector<double> sendBuffer;
+    std::vector<int> nSend(nTasks);
+    std::vector<int> sendOffset(nTasks + 1, 0);
+    for (int proc = 0; proc < nTasks; proc++)
     {
-        // Single processor
-        subdomainInfo.startingParticle = 0;
-        subdomainInfo.endingParticle = field.pos[0].size() - 1;
-        return;
+        packParticles(field, sendList[proc], 0, sendBuffer, nPackedValues);
+        nSend[proc] = nPackedValues * sendList[proc].size();
+        sendOffset[proc + 1] = sendOffset[proc] + nSend[proc];
     }
+
+    // Exchanges the counts, then the particles
+    std::vector<int> nRecv(nTasks);
+    std::vector<int> recvOffset(nTasks + 1, 0);
+    MPI_Alltoall(&nSend[0], 1, MPI_INT, &nRecv[0], 1, MPI_INT, MPI_COMM_WORLD);
+    for (int proc = 0; proc < nTasks; proc++)
+        recvOffset[proc + 1] = recvOffset[proc] + nRecv[proc];
+    std::vector<double> recvBuffer(recvOffset[nTasks]);
+    MPI_Alltoallv(sendBuffer.data(), &nSend[0], &sendOffset[0], MPI_DOUBLE,
+                  recvBuffer.data(), &nRecv[0], &recvOffset[0], MPI_DOUBLE, MPI_COMM_WORLD);
+
+    // Adds the new particles (the sent ones are removed by shareMigrate)
+    int n = field.pos[0].size();
+    int nNew = recvOffset[nTasks] / nPackedValues;
+    sizeField(field, n + nNew);
+    unpackParticles(recvBuffer, nNew, field, n, nPackedValues, parameter);
 }
 
-void shareMigrate(Field &field, SubdomainInfo &subdomainInfo)
+/*
+Input:
+    - field: local field WITHOUT halos
+Description:
+    Sends the particles that have left the subdomain to the neighbor that
+    now contains them, and receives the particles entering the subdomain.
+    The particles that went further than a neighbor (too large time step,
+    splashes, thin subdomains) are sent by shareFarMigrate.
+*/
+void shareMigrate(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo)
 {
-    // Declarations
+    int nNeighbors = subdomainInfo.neighbors.size();
+
+    // Destination of each particle
     std::vector<std::pair<int, int>> indexMigrate;
-    std::vector<double> recvVectL[9], recvVectR[9];
-    std::vector<int> recvVectTypeL, recvVectTypeR;
-    int nMigrate[2];
-    int startMigrateToLeft, startMigrateToRight;
-    int sizeRecvMigrate;
-
-    // Useful information
-    double l0 = field.l[0];
-    double u0 = field.u[0];
-    double boxSize = subdomainInfo.boxSize;
-    int procID = subdomainInfo.procID;
-    int nTasks = subdomainInfo.nTasks;
+    std::vector<int> nMigrate(nNeighbors + 2, 0);
+    computeMigrateIndex(field, subdomainInfo, indexMigrate, nMigrate);
+
+    // Number of particles going further than a neighbor (all processes)
+    int nFar = nMigrate[nNeighbors + 1];
+    int nFarTotal;
+    MPI_Allreduce(&nFar, &nFarTotal, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (nFarTotal > 0 && subdomainInfo.procID == 0)
+    {
+        std::cout << "\n"
+                  << nFarTotal << " particle(s) travelled more than one subdomain in one time step." << std::endl;
+    }
 
-    // Different possible cases (trivial if only one node)
-    if (nTasks > 1)
+    // Packs the leaving particles
+    std::vector<std::vector<double>> &sendBuffer = subdomainInfo.sendBuffer;
+    std::vector<std::vector<double>> &recvBuffer = subdomainInfo.recvBuffer;
+    std::vector<std::vector<int>> sendList(nNeighbors + 1); // the last one goes further
+    std::vector<int> stayList;
+    stayList.reserve(nMigrate[0]);
+    for (unsigned int i = 0; i < indexMigrate.size(); i++)
     {
-        if (procID == 0)
-        { // No left neighbor domain
-            // inner domain: [l[0] , u[0] - 2*boxSize[
-            // right edge: [u[0] - 2*boxSize , u[0] - boxSize[
-            // right halo: [u[0] - boxSize , u[0]]
-            computeMigrateIndex(field.pos[0], indexMigrate, nMigrate, l0, u0 - boxSize);
-            sortParticles(field, indexMigrate);
-
-            // Start position to send
-            startMigrateToRight = field.pos[0].size() - nMigrate[1];
-
-            // Sends the edge to the right
-            MPI_Send(&nMigrate[1], 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-            MPI_Send_All(field, startMigrateToRight, nMigrate[1], procID + 1, migration);
-            // Nothing to send to the left
-
-            // Nothing to receive from the left
-            // Receives the halo from the right
-            MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            for (int i = 0; i < 9; i++)
-            {
-                recvVectR[i].resize(sizeRecvMigrate);
-            }
-            recvVectTypeR.resize(sizeRecvMigrate);
-            MPI_Recv_All(recvVectR, recvVectTypeR, sizeRecvMigrate, procID + 1, migration);
-            // Removing previous particles (even those who go out of the domain! Keep it? )
-            resizeField(field, nMigrate[0] + nMigrate[1]); // OR: remove only the right ones (on the left, out of the domain but keep them)
-            // Adding the particles to the field
-            insertParticles(field, recvVectR, recvVectTypeR, end);
-        }
-        else if (procID == nTasks - 1)
-        { // No right neighbor domain
-            // left halo: [l[0] , l[0] + boxSize[
-            // left edge: [l[0] + boxSize , l[0] + 2*boxSize[
-            // inner domain: [l[0] + 2*boxSize , u[0][
-            computeMigrateIndex(field.pos[0], indexMigrate, nMigrate, l0 + boxSize, u0);
-            sortParticles(field, indexMigrate);
-
-            // Start position to send
-            //startMigrateToRight = field.pos[0].size() - nMigrate[1]; USELESS
-            startMigrateToLeft = field.pos[0].size() - nMigrate[1] - nMigrate[0];
-
-            if (procID % 2 == 0)
-            {
-                // Nothing to send to the right
-                // Sends the edge to the left (procID is even)
-                MPI_Send(&nMigrate[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startMigrateToLeft, nMigrate[0], procID - 1, migration);
-
-                // Receives the edge from the left (procID is even)
-                MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvMigrate);
-                }
-                recvVectTypeL.resize(sizeRecvMigrate);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvMigrate, procID - 1, migration);
-                // Nothing to receive from the right
-
-                // Removing previous particles
-                resizeField(field, nMigrate[0] + nMigrate[1]);
-                // Adding the particles to the field
-            }
-            else
-            {
-                // Receives the edge from the left (procID is odd)
-                MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvMigrate);
-                }
-                recvVectTypeL.resize(sizeRecvMigrate);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvMigrate, procID - 1, migration);
-                // Nothing to receive from the right
-
-                // Nothing to send to the right
-                // Sends the edge to the left (procID is odd)
-                MPI_Send(&nMigrate[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startMigrateToLeft, nMigrate[0], procID - 1, migration);
-
-                // Removing previous particles
-                resizeField(field, nMigrate[0] + nMigrate[1]);
-            }
-            // Adding the particles to the field
-            insertParticles(field, recvVectL, recvVectTypeL, end);
-        }
+        if (indexMigrate[i].first == 0)
+            stayList.push_back(indexMigrate[i].second);
         else
-        { // Domain in the middle
-            // left halo: [l[0] , l[0] + boxSize[
-            // left edge: [l[0] + boxSize , l[0] + 2*boxSize[
-            // inner domain: [l[0] + 2*boxSize , u[0] - 2*boxSize[
-            // right edge: [u[0] - 2*boxSize , u[0] - boxSize[
-            // right halo: [u[0] - boxSize , u[0]]
-            computeMigrateIndex(field.pos[0], indexMigrate, nMigrate, l0 + boxSize, u0 - boxSize);
-            sortParticles(field, indexMigrate);
-
-            // Start positions to send
-            startMigrateToRight = field.pos[0].size() - nMigrate[1];
-            startMigrateToLeft = field.pos[0].size() - nMigrate[1] - nMigrate[0];
-
-            if (procID % 2 == 0)
-            {
-                // Sends the edge to the right (procID is even)
-                MPI_Send(&nMigrate[1], 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startMigrateToRight, nMigrate[1], procID + 1, migration);
-                // Sends the edge to the left (procID is even)
-                MPI_Send(&nMigrate[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startMigrateToLeft, nMigrate[0], procID - 1, migration);
-
-                // Receives the edge from the left (procID is even)
-                MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvMigrate);
-                }
-                recvVectTypeL.resize(sizeRecvMigrate);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvMigrate, procID - 1, migration);
-                // Receives the edge from the right (procID is even)
-                MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectR[i].resize(sizeRecvMigrate);
-                }
-                recvVectTypeR.resize(sizeRecvMigrate);
-                MPI_Recv_All(recvVectR, recvVectTypeR, sizeRecvMigrate, procID + 1, migration);
-
-                // Removing previous particles
-                resizeField(field, nMigrate[0] + nMigrate[1]);
-            }
-            else
-            {
-                // Receives the edge from the left (procID is odd)
-                MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectL[i].resize(sizeRecvMigrate);
-                }
-                recvVectTypeL.resize(sizeRecvMigrate);
-                MPI_Recv_All(recvVectL, recvVectTypeL, sizeRecvMigrate, procID - 1, migration);
-                // Receives the edge from the right (procID is odd)
-                MPI_Recv(&sizeRecvMigrate, 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                for (int i = 0; i < 9; i++)
-                {
-                    recvVectR[i].resize(sizeRecvMigrate);
-                }
-                recvVectTypeR.resize(sizeRecvMigrate);
-                MPI_Recv_All(recvVectR, recvVectTypeR, sizeRecvMigrate, procID + 1, migration);
-
-                // Sends the edge to the right (procID is odd)
-                MPI_Send(&nMigrate[1], 1, MPI_INT, procID + 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startMigrateToRight, nMigrate[1], procID + 1, migration);
-                // Sends the edge to the left (procID is odd)
-                MPI_Send(&nMigrate[0], 1, MPI_INT, procID - 1, dataExch, MPI_COMM_WORLD);
-                MPI_Send_All(field, startMigrateToLeft, nMigrate[0], procID - 1, migration);
-
-                // Removing previous particles
-                resizeField(field, nMigrate[0] + nMigrate[1]);
-            }
-            // Adding the particles to the field
-            insertParticles(field, recvVectL, recvVectTypeL, end);
-            insertParticles(field, recvVectR, recvVectTypeR, end);
-        }
+            sendList[indexMigrate[i].first - 1].push_back(indexMigrate[i].second);
     }
-    else
+    sendBuffer.resize(nNeighbors);
+    for (int k = 0; k < nNeighbors; k++)
     {
-        // Single processor
-        return;
+        sendBuffer[k].clear();
+        packParticles(field, sendList[k], 0, sendBuffer[k], nPackedValues);
+    }
+    if (nFarTotal > 0)
+        shareFarMigrate(field, sendList[nNeighbors], parameter, subdomainInfo);
+
+    // Removes them (the particles received from far subdomains are at the end and kept)
+    if (nMigrate[0] < (int)indexMigrate.size())
+    {
+        for (int i = indexMigrate.size(); i < (int)field.pos[0].size(); i++)
+            stayList.push_back(i);
+        keepParticles(field, stayList);
+    }
+
+    // Exchanges them with the neighbors and adds the new ones at the end
+    exchangePacked(sendBuffer, recvBuffer, migration, subdomainInfo);
+    int n = field.pos[0].size();
+    int nNew = 0;
+    for (int k = 0; k < nNeighbors; k++)
+        nNew += recvBuffer[k].size() / nPackedValues;
+    sizeField(field, n + nNew);
+    for (int k = 0; k < nNeighbors; k++)
+    {
+        int nRecv = recvBuffer[k].size() / nPackedValues;
+        unpackParticles(recvBuffer[k], nRecv, field, n, nPackedValues, parameter);
+        n += nRecv;
     }
 }
 
-void processUpdate(Field &localField, SubdomainInfo &subdomainInfo)
+void processUpdate(Field &localField, Parameter *parameter, SubdomainInfo &subdomainInfo)
 {
     if (subdomainInfo.nTasks == 1)
     {
         return;
     }
+    // Lazy migration: the halos keep the same particles, only their values are updated
+    if (subdomainInfo.haloDepth > 1 && !skinExceeded(localField, subdomainInfo))
+    {
+        startHaloUpdate(localField, subdomainInfo);
+        waitHalos(localField, parameter, subdomainInfo);
+        return;
+    }
     // --- call deleteHalos ---
     deleteHalos(localField, subdomainInfo);
     // --- call sendMigrate ---
-    shareMigrate(localField, subdomainInfo);
+    shareMigrate(localField, parameter, subdomainInfo);
     // --- call shareOverlap ---
-    shareOverlap(localField, subdomainInfo);
-
-    localField.nTotal = localField.pos[0].size();
-    // Computes nFree, nMoving and nFixed
-    localField.nFree = 0;
-    localField.nFixed = 0;
-    localField.nMoving = 0;
-    for (int i = 0; i < localField.nTotal; i++)
-    {
-        switch (localField.type[i])
-        {
-        case freePart:
-            localField.nFree++;
-            break;
-        case fixedPart:
-            localField.nFixed++;
-            break;
-        default:
-            localField.nMoving++;
-        }
-    }
+    shareOverlap(localField, parameter, subdomainInfo);
+
+    // Computes nTotal, nFree, nMoving and nFixed
+    countParticles(localField);
 }
 
 void timeStepUpdate(double &nextK, double &localProposition, SubdomainInfo &subdomainInfo)
@@ -928,154 +1137,129 @@ void timeStepUpdate(double &nextK, double &localProposition, SubdomainInfo &subd
     MPI_Bcast(&nextK, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 }
 
-void computeDomainIndex(std::vector<double> &posX,
-                        std::vector<double> &limits, std::vector<int> &nbPartNode,
-                        std::vector<std::pair<int, int>> &index, int nTasks)
+
+void computeDomainIndex(Field &field, SubdomainInfo &subdomainInfo, std::vector<int> &nbPartNode,
+                        std::vector<std::pair<int, int>> &index)
 {
     // Loop over particles
-    for (int i = 0; i < posX.size(); i++)
+    int box[3];
+    for (unsigned int i = 0; i < field.pos[0].size(); i++)
     {
-        int domainNumber = getDomainNumber(posX[i], limits, nTasks);
+        globalBox(field, i, subdomainInfo, box);
+        int domainNumber = getDomainNumber(box, subdomainInfo);
         index.push_back(std::make_pair(domainNumber, i));
         nbPartNode[domainNumber]++;
     }
 }
 
-int getDomainNumber(double x, std::vector<double> &limits, int nTasks)
-{
-    //Improvement: implement a tree based search.
-    int i;
-    for (i = 0; i < nTasks && x > limits[i]; i++)
-        ;
-    return i - 1;
-}
-
-// left halo: [l[0] , l[0] + boxSize[
-// left edge: [l[0] + boxSize , l[0] + 2*boxSize[
-// inner domain: [l[0] + 2*boxSize , u[0] - 2*boxSize[
-// right edge: [u[0] - 2*boxSize , u[0] - boxSize[
-// right halo: [u[0] - boxSize , u[0]]
-void computeMigrateIndex(std::vector<double> &posX,
-                         std::vector<std::pair<int, int>> &index, int *nMigrate,
-                         double Xmin, double Xmax)
+// Index 0: the particle stays, index k+1: the particle goes to neighbors[k],
+// index nNeighbors+1: the particle goes to a process that is not a neighbor
+void computeMigrateIndex(Field &field, SubdomainInfo &subdomainInfo,
+                         std::vector<std::pair<int, int>> &index, std::vector<int> &nMigrate)
 {
-
-    nMigrate[0] = 0;
-    nMigrate[1] = 0;
-    for (unsigned int i = 0; i < posX.size(); ++i)
+    int nNeighbors = subdomainInfo.neighbors.size();
+    int *lo = &subdomainInfo.subdomainBoxes[6 * subdomainInfo.procID];
+    int *hi = lo + 3;
+    int N = field.pos[0].size();
+    index.resize(N);
+#pragma omp parallel for
+    for (int i = 0; i < N; ++i)
     {
-        if (posX[i] > Xmax)
-        {
-            index.push_back(std::make_pair(rightMigrate, i));
-            ++nMigrate[1];
-        }
-        else if (posX[i] <= Xmin)
+        int box[3];
+        globalBox(field, i, subdomainInfo, box);
+        int key = 0;
+        if (box[0] < lo[0] || box[0] >= hi[0] || box[1] < lo[1] || box[1] >= hi[1] ||
+            box[2] < lo[2] || box[2] >= hi[2])
         {
-            index.push_back(std::make_pair(leftMigrate, i));
-            ++nMigrate[0];
-        }
-        else
-        {
-            index.push_back(std::make_pair(noMigrate, i));
+            int neighbor = getNeighborNumber(getDomainNumber(box, subdomainInfo), subdomainInfo);
+            key = (neighbor < 0) ? nNeighbors + 1 : neighbor + 1;
         }
+        index[i] = std::make_pair(key, i);
     }
+    for (int i = 0; i < N; ++i)
+        ++nMigrate[index[i].first];
 }
 
-void computeOverlapIndex(std::vector<double> &posX,
-                         std::vector<std::pair<int, int>> &index, int *nOverlap,
-                         double leftMinX, double leftMaxX, double rightMinX, double rightMaxX)
+// sendList[k]: particles of the subdomain that lie in the halo of neighbors[k]
+void computeOverlapIndex(Field &field, SubdomainInfo &subdomainInfo, std::vector<std::vector<int>> &sendList)
 {
-
-    nOverlap[0] = 0;
-    nOverlap[1] = 0;
-    for (unsigned int i = 0; i < posX.size(); ++i)
+    int nNeighbors = subdomainInfo.neighbors.size();
+    int depth = subdomainInfo.haloDepth;
+    int *lo = &subdomainInfo.subdomainBoxes[6 * subdomainInfo.procID];
+    int *hi = lo + 3;
+    sendList.assign(nNeighbors, std::vector<int>());
+    int box[3];
+    for (unsigned int i = 0; i < field.pos[0].size(); ++i)
     {
-        if (posX[i] > rightMinX && posX[i] <= rightMaxX)
+        globalBox(field, i, subdomainInfo, box);
+        // Inner particles are in no halo
+        if (box[0] >= lo[0] + depth && box[0] < hi[0] - depth && box[1] >= lo[1] + depth &&
+            box[1] < hi[1] - depth && box[2] >= lo[2] + depth && box[2] < hi[2] - depth)
+            continue;
+        for (int k = 0; k < nNeighbors; k++)
         {
-            index.push_back(std::make_pair(rightOverlap, i));
-            ++nOverlap[1];
-        }
-        else if (posX[i] <= leftMaxX && posX[i] > leftMinX)
-        {
-            index.push_back(std::make_pair(leftOverlap, i));
-            ++nOverlap[0];
-        }
-        else if (posX[i] < leftMinX || posX[i] > rightMaxX)
-        { // TO MAKE SURE EVERYTHING IS OK !
-            std::cout << "Particle " << i << " with position " << posX[i] << " should not be here !!" << std::endl;
-            std::cout << "This particle has travelled more than one subdomain in one time step." << std::endl;
-            std::cout << "The time step is probably too large and the numerical integration has diverged." << std::endl;
-        }
-        else
-        {
-            index.push_back(std::make_pair(noOverlap, i));
+            int *neighborLo = &subdomainInfo.subdomainBoxes[6 * subdomainInfo.neighbors[k]];
+            int *neighborHi = neighborLo + 3;
+            bool inHalo = true;
+            for (int j = 0; j < 3 && inHalo; j++)
+                inHalo = (box[j] >= neighborLo[j] - depth && box[j] < neighborHi[j] + depth);
+            if (inHalo)
+                sendList[k].push_back(i);
         }
     }
 }
 
-bool sortFunction(const std::pair<int, int> &one, const std::pair<int, int> &two)
-{
-    return (one.first < two.first);
-}
-
+/*
+Input:
+    - index: (key, particle) for each particle of the field, keys >= 0
+Description:
+    Reorders the particles of the field by increasing key (particles with the
+    same key keep their order). The keys are counted (linear time) and all the
+    vectors of the field are permuted in one parallel pass.
+*/
 void sortParticles(Field &field, std::vector<std::pair<int, int>> &index)
 {
-    // Sort the index vector
-    std::sort(index.begin(), index.end(), sortFunction);
-    int N = field.pos[0].size();
-
-    // Temporary vectors for sorting
-    std::vector<double> tmp(N);
-    std::vector<int> tmpType(N);
-
-    // --- Sorts all data one by one ---
-    int i, coord;
-    for (coord = 0; coord < 3; coord++)
+    int N = index.size();
+
+    // Counts the particles of each key
+    int nKeys = 0;
+    for (int i = 0; i < N; i++)
+        nKeys = std::max(nKeys, index[i].first + 1);
+    std::vector<int> offset(nKeys + 1, 0);
+    for (int i = 0; i < N; i++)
+        offset[index[i].first + 1]++;
+    for (int key = 0; key < nKeys; key++)
+        offset[key + 1] += offset[key];
+
+    // Position of each particle in the sorted field
+    std::vector<int> source(N);
+    for (int i = 0; i < N; i++)
+        source[offset[index[i].first]++] = index[i].second;
+
+    // Permutes all the vectors at once
+    Field sortedField;
+    sizeField(sortedField, N);
+#pragma omp parallel for
+    for (int i = 0; i < N; i++)
     {
-        // Position reordering
-        for (i = 0; i < N; ++i)
-            tmp[i] = field.pos[coord][index[i].second];
-        (field.pos[coord]).swap(tmp);
-        // Speed reordering
-        for (i = 0; i < N; ++i)
-            tmp[i] = field.speed[coord][index[i].second];
-        (field.speed[coord]).swap(tmp);
+        int j = source[i];
+        for (int coord = 0; coord < 3; coord++)
+        {
+            sortedField.pos[coord][i] = field.pos[coord][j];
+            sortedField.speed[coord][i] = field.speed[coord][j];
+        }
+        sortedField.density[i] = field.density[j];
+        sortedField.pressure[i] = field.pressure[j];
+        sortedField.mass[i] = field.mass[j];
+        sortedField.type[i] = field.type[j];
     }
-    // Density reordering
-    for (i = 0; i < N; ++i)
-        tmp[i] = field.density[index[i].second];
-    (field.density).swap(tmp);
-    // Pressure reordering
-    for (i = 0; i < N; ++i)
-        tmp[i] = field.pressure[index[i].second];
-    (field.pressure).swap(tmp);
-    // Mass reordering
-    for (i = 0; i < N; ++i)
-        tmp[i] = field.mass[index[i].second];
-    (field.mass).swap(tmp);
-    // Type reordering
-    for (i = 0; i < N; ++i)
-        tmpType[i] = field.type[index[i].second];
-    (field.type).swap(tmpType);
-}
-
-void resizeField(Field &field, int nMigrate)
-{
-    int finalSize = (field.pos[0]).size() - nMigrate;
-    int coord;
-    for (coord = 0; coord < 3; coord++)
+    for (int coord = 0; coord < 3; coord++)
     {
-        // Position resize
-        (field.pos[coord]).resize(finalSize);
-        // Speed resize
-        (field.speed[coord]).resize(finalSize);
+        field.pos[coord].swap(sortedField.pos[coord]);
+        field.speed[coord].swap(sortedField.speed[coord]);
     }
-    // Density resize
-    (field.density).resize(finalSize);
-    // Pressure resize
-    (field.pressure).resize(finalSize);
-    // Mass resize
-    (field.mass).resize(finalSize);
-    // Type resize
-    (field.type).resize(finalSize);
+    field.density.swap(sortedField.density);
+    field.pressure.swap(sortedField.pressure);
+    field.mass.swap(sortedField.mass);
+    field.type.swap(sortedField.type);
 }
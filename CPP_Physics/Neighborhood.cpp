@@ -81,6 +81,36 @@ double boxSizeCalc(double kh, IntegrationMethod method)
     return kh * multiplicator;
 }
 
+// Splits the boxes into inner boxes (no halo particle in their surrounding boxes) and edge boxes
+void splitBoxes(std::vector<std::vector<int>> &boxes, std::vector<std::vector<int>> &surrBoxesAll,
+                int startingParticle, int endingParticle,
+                std::vector<int> &innerBoxes, std::vector<int> &edgeBoxes)
+{
+    // Boxes containing at least one halo particle
+    std::vector<bool> haloBox(boxes.size(), false);
+    for (unsigned int box = 0; box < boxes.size(); box++)
+    {
+        for (unsigned int part = 0; part < boxes[box].size() && !haloBox[box]; part++)
+        {
+            if (boxes[box][part] < startingParticle || boxes[box][part] > endingParticle)
+                haloBox[box] = true;
+        }
+    }
+
+    innerBoxes.clear();
+    edgeBoxes.clear();
+    for (unsigned int box = 0; box < boxes.size(); box++)
+    {
+        bool inner = true;
+        for (unsigned int i = 0; i < surrBoxesAll[box].size() && inner; i++)
+            inner = !haloBox[surrBoxesAll[box][i]];
+        if (inner)
+            innerBoxes.push_back(box);
+        else
+            edgeBoxes.push_back(box);
+    }
+}
+
 // Sorts the particles into cubic boxes
 void sortParticles(std::vector<double> (&pos)[3], double l[3], double u[3], double boxSize,
                    std::vector<std::vector<int>> &boxes)
@@ -115,7 +115,8 @@ a list with the box ID of the boxes that are adjacent to this box
 *- currentDensityDerivative: vector containing derivative of density for each particle at time t
 *- currentSpeedDerivative: vector containing derivative of velocity for each particle at time t
 *Description:
-* Knowing the field (currentField), computes the density and velocity derivatives and store them in vectors
+* Knowing the field (currentField), computes the density and velocity derivatives and store them in vectors.
+* If a halo exchange is pending (RK2 midpoint), the inner boxes are computed while the halos are received.
 */
 void derivativeComputation(Field *currentField, Parameter *parameter,
                            SubdomainInfo &subdomainInfo,
@@ -132,34 +133,68 @@ void derivativeComputation(Field *currentField, Parameter *parameter,
     std::vector<double> kernelGradients;
     std::vector<double> viscosity;
 
+    // Compute time measurement (load balancing)
+    double startTime = MPI_Wtime();
+
     // Sort the particles at the current time step
     if (!midPoint)
     {
         sortParticles(currentField->pos, currentField->l, currentField->u, subdomainInfo.boxSize, boxes);
     } // At each time step, restart it
 
-// Spans the boxes
-#pragma omp parallel for private(neighbors, kernelGradients, kernelValues, viscosity) schedule(dynamic)
-    for (int box = subdomainInfo.startingBox; box <= subdomainInfo.endingBox; box++)
+    // Boxes computed before (inner) and after (edge) the reception of the halos
+    std::vector<int> boxList[2];
+    if (!subdomainInfo.haloPending)
+    {
+        boxList[0].resize(boxes.size());
+        for (unsigned int box = 0; box < boxes.size(); box++)
+            boxList[0][box] = box;
+    }
+    else
+    {
+        splitBoxes(boxes, surrBoxesAll, subdomainInfo.startingParticle, subdomainInfo.endingParticle,
+                   boxList[0], boxList[1]);
+    }
+
+    double waitTime = 0.0;
+    for (int step = 0; step < 2; step++)
     {
-        // Spans the particles in the box
-        for (unsigned int part = 0; part < boxes[box].size(); part++)
+        if (step == 1)
         {
-            // Declarations
-            int particleID = boxes[box][part];
-            neighbors.resize(0);
-            kernelValues.resize(0);
-            kernelGradients.resize(0);
-            // Neighbor search
-            findNeighbors(particleID, currentField->pos, parameter->kh, boxes, surrBoxesAll[box], neighbors, kernelGradients, kernelValues, parameter->kernel);
-            // Continuity equation
-            currentDensityDerivative[particleID] = continuity(particleID, neighbors, kernelGradients, currentField);
-            // Momentum equation only for free particles
-            if (currentField->type[particleID] == freePart)
-                momentum(particleID, neighbors, kernelGradients, currentField, parameter, currentSpeedDerivative, viscosity);
-            xsphCorrection(particleID, neighbors, kernelValues, currentField, parameter, currentPositionDerivative);
+            double startWait = MPI_Wtime();
+            waitHalos(*currentField, parameter, subdomainInfo);
+            waitTime = MPI_Wtime() - startWait;
+        }
+
+        // Spans the boxes
+        std::vector<int> &currentBoxes = boxList[step];
+#pragma omp parallel for private(neighbors, kernelGradients, kernelValues, viscosity) schedule(dynamic)
+        for (int b = 0; b < (int)currentBoxes.size(); b++)
+        {
+            int box = currentBoxes[b];
+            // Spans the particles in the box
+            for (unsigned int part = 0; part < boxes[box].size(); part++)
+            {
+                // Declarations
+                int particleID = boxes[box][part];
+                // Halo particles: computed by their own process
+                if (particleID < subdomainInfo.startingParticle || particleID > subdomainInfo.endingParticle)
+                    continue;
+                neighbors.resize(0);
+                kernelValues.resize(0);
+                kernelGradients.resize(0);
+                // Neighbor search
+                findNeighbors(particleID, currentField->pos, parameter->kh, boxes, surrBoxesAll[box], neighbors, kernelGradients, kernelValues, parameter->kernel);
+                // Continuity equation
+                currentDensityDerivative[particleID] = continuity(particleID, neighbors, kernelGradients, currentField);
+                // Momentum equation only for free particles
+                if (currentField->type[particleID] == freePart)
+                    momentum(particleID, neighbors, kernelGradients, currentField, parameter, currentSpeedDerivative, viscosity);
+                xsphCorrection(particleID, neighbors, kernelValues, currentField, parameter, currentPositionDerivative);
+            }
         }
     }
+    subdomainInfo.computeTime += MPI_Wtime() - startTime - waitTime;
 }
 
 /*
@@ -217,8 +252,8 @@ void timeIntegration(Field *currentField, Field *nextField, Parameter *parameter
         // Storing midpoint in midField
         eulerUpdate(currentField, midField, parameter, subdomainInfo, currentDensityDerivative,
                     currentSpeedDerivative, currentPositionDerivative, t, kMid);
-        // Share the mid point
-        shareRKMidpoint(*midField, subdomainInfo);
+        // Share the mid point (completed during the derivative computation)
+        startHaloUpdate(*midField, subdomainInfo);
         // Compute derivatives at midPoint
         derivativeComputation(midField, parameter, subdomainInfo, boxes, surrBoxesAll,
                               midDensityDerivative, midSpeedDerivative, midPositionDerivative, true);
@@ -0,0 +1,116 @@
+///**************************************************************************
+/// SOURCE: Detection of the free-surface particles (freeSurface output).
+///**************************************************************************
+#include "Main.h"
+#include "Physics.h"
+#include "Tools.h"
+#include <map>
+
+/*
+Input:
+    - volume: volume of a particle
+    - parameter: kernel and kh
+Output:
+    - divergence of the position of a particle in a full cubic lattice of
+      particles of this volume, i.e. its value in the bulk of the fluid at
+      this resolution (3 for a continuous fluid)
+*/
+static double latticeDivergence(double volume, Parameter *parameter)
+{
+    double s = cbrt(volume);
+    int n = (int)(parameter->kh / s);
+    double divergence = 0.0;
+    for (int a = -n; a <= n; a++)
+        for (int b = -n; b <= n; b++)
+            for (int c = -n; c <= n; c++)
+            {
+                double r = s * sqrt((double)(a * a + b * b + c * c));
+                if (r > 0.0 && r < parameter->kh)
+                    divergence -= volume * r * gradWab(r, parameter->kh, parameter->kernel);
+            }
+    return divergence;
+}
+
+/*
+Input:
+    - field: field whose particles [first, end[ are tested (the others, e.g. the halos, are only neighbors)
+    - first, end: particles tested
+    - parameter: kernel, kh and surfaceThreshold
+    - normals: if true, field->normal is sized to the field and set for the surface particles
+Output:
+    - surface: the free particles of [first, end[ on the free surface, in increasing order
+Description:
+    A free particle i is on the free surface if the divergence of the position,
+    sum_j V_j (r_j - r_i).grad W_ij with V_j = m_j/rho_j, is below surfaceThreshold
+    times its value in a full lattice of particles of volume V_i: the missing
+    neighbors above the surface lower it (the fixed particles are neighbors, so
+    that the walls are not detected). The normal is the opposite of the
+    gradient of the kernel sum, normalized (it points out of the fluid).
+*/
+void freeSurface(Field *field, int first, int end, Parameter *parameter, std::vector<int> &surface, bool normals)
+{
+    std::vector<std::vector<int>> boxes;
+    std::vector<std::vector<int>> surrBoxesAll;
+    boxMesh(field->l, field->u, parameter->kh, boxes, surrBoxesAll);
+    sortParticles(field->pos, field->l, field->u, parameter->kh, boxes);
+
+    // Bulk values, by bins of 1% of the particle volume (the density changes slowly)
+    std::map<long, double> bulk;
+    for (int i = first; i < end; i++)
+        if (field->type[i] == freePart)
+            bulk[lround(100.0 * log(field->mass[i] / field->density[i]))] = 0.0;
+    for (std::map<long, double>::iterator it = bulk.begin(); it != bulk.end(); ++it)
+        it->second = latticeDivergence(exp(it->first / 100.0), parameter);
+
+    std::vector<char> onSurface(field->pos[0].size(), 0);
+    if (normals)
+        for (int coord = 0; coord < 3; coord++)
+            field->normal[coord].assign(field->pos[0].size(), 0.0);
+
+    std::vector<int> neighbors;
+    std::vector<double> kernelGradients;
+    std::vector<double> kernelValues;
+#pragma omp parallel for private(neighbors, kernelGradients, kernelValues) schedule(dynamic)
+    for (int box = 0; box < (int)boxes.size(); box++)
+    {
+        for (unsigned int part = 0; part < boxes[box].size(); part++)
+        {
+            int particleID = boxes[box][part];
+            if (particleID < first || particleID >= end || field->type[particleID] != freePart)
+                continue;
+            neighbors.resize(0);
+            kernelGradients.resize(0);
+            kernelValues.resize(0);
+            findNeighbors(particleID, field->pos, parameter->kh, boxes, surrBoxesAll[box], neighbors,
+                          kernelGradients, kernelValues, parameter->kernel);
+
+            // Divergence of the position and gradient of the kernel sum
+            double divergence = 0.0;
+            double gradient[3] = {0.0, 0.0, 0.0};
+            for (unsigned int j = 0; j < neighbors.size(); j++)
+            {
+                double volume = field->mass[neighbors[j]] / field->density[neighbors[j]];
+                for (int coord = 0; coord < 3; coord++)
+                {
+                    divergence -= volume * (field->pos[coord][particleID] - field->pos[coord][neighbors[j]]) *
+                                  kernelGradients[3 * j + coord];
+                    gradient[coord] += volume * kernelGradients[3 * j + coord];
+                }
+            }
+            double reference = bulk.find(lround(100.0 * log(field->mass[particleID] / field->density[particleID])))->second;
+            if (divergence >= parameter->surfaceThreshold * reference)
+                continue;
+
+            onSurface[particleID] = 1;
+            double norm = sqrt(gradient[0] * gradient[0] + gradient[1] * gradient[1] + gradient[2] * gradient[2]);
+            if (normals && norm > 0.0)
+                for (int coord = 0; coord < 3; coord++)
+                    field->normal[coord][particleID] = -gradient[coord] / norm;
+        }
+    }
+
+    surface.clear();
+    for (int i = first; i < end; i++)
+        if (onSurface[i])
+            surface.push_back(i);
+}
@@ -89,6 +89,105 @@ Error consistencyParameters(Parameter *parameter)
                   << std::endl;
         cntError++;
     }
+    if (parameter->balanceInterval < 0)
+    {
+        std::cout << "Invalid balanceInterval.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->balanceTolerance < 0.0)
+    {
+        std::cout << "Invalid balanceTolerance.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->haloSkin < 0)
+    {
+        std::cout << "Invalid haloSkin.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->distributedInit != 0 && parameter->distributedInit != 1)
+    {
+        std::cout << "Invalid distributedInit.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->asyncWrite != 0 && parameter->asyncWrite != 1)
+    {
+        std::cout << "Invalid asyncWrite.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->compressionLevel < -1 || parameter->compressionLevel > 9)
+    {
+        std::cout << "Invalid compressionLevel.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->compressionFilter < 0 || parameter->compressionFilter > 2)
+    {
+        std::cout << "Invalid compressionFilter.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->directWrite != 0 && parameter->directWrite != 1)
+    {
+        std::cout << "Invalid directWrite.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->staticBoundary < 0 || parameter->staticBoundary > 2)
+    {
+        std::cout << "Invalid staticBoundary.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if ((parameter->skipUnchanged != 0 && parameter->skipUnchanged != 1) ||
+        (parameter->skipUnchanged == 1 && parameter->parallelOutput != gatheredOutput))
+    {
+        std::cout << "Invalid skipUnchanged (the results must be gathered: parallelOutput=0).\n"
+                  << std::endl;
+        cntError++;
+    }
+    if ((parameter->archive != 0 && parameter->archive != 1) ||
+        (parameter->archive == 1 && parameter->parallelOutput != gatheredOutput))
+    {
+        std::cout << "Invalid archive (the results must be gathered: parallelOutput=0).\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->freeSurface < 0 || parameter->freeSurface > 2 || parameter->surfaceThreshold <= 0.0)
+    {
+        std::cout << "Invalid freeSurface or surfaceThreshold.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->stride < 1 || parameter->minSpeed < 0.0)
+    {
+        std::cout << "Invalid stride or minSpeed.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->roi.size() == 6 &&
+        (parameter->roi[0] > parameter->roi[3] || parameter->roi[1] > parameter->roi[4] || parameter->roi[2] > parameter->roi[5]))
+    {
+        std::cout << "Invalid roi (lower corner above the upper one).\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->probeInterval < 1)
+    {
+        std::cout << "Invalid probe interval.\n"
+                  << std::endl;
+        cntError++;
+    }
+    if (parameter->checkpointInterval < 0 || parameter->checkpointPeriod < 0.0)
+    {
+        std::cout << "Invalid checkpointInterval or checkpointPeriod.\n"
+                  << std::endl;
+        cntError++;
+    }
     if (cntError != 0)
     {
         return consistencyError;
@@ -1,3 +1,17 @@
-
 #include "Main.h"
 #include "Interface.h"
+#include "Tools.h"
+
+/* Resizes all the vectors of a field to n particles */
+void sizeField(Field &field, int n)
+{
+    for (int coord = 0; coord < 3; coord++)
+    {
+        field.pos[coord].resize(n);
+        field.speed[coord].resize(n);
+    }
+    field.density.resize(n);
+    field.pressure.resize(n);
+    field.mass.resize(n);
+    field.type.resize(n);
+}
@@ -14,21 +14,55 @@
 
 // inputReader.cpp
 Error readParameter(std::string filename, Parameter *parameter);
-Error readGeometry(std::string filename, Field *currentField, Parameter *parameter, std::vector<double> *volVector);
-Error initializeField(std::string filename, Field *currentField, Parameter *parameter);
+Error readGeometry(std::string filename, Field *currentField, Parameter *parameter, std::vector<double> *volVector,
+                   SubdomainInfo *region = NULL);
+Error initializeField(std::string filename, Field *currentField, Parameter *parameter, SubdomainInfo *region = NULL);
 
 // writeField.cpp
 std::string creatDirectory(std::string dirname);
 
-void writeField(Field *field, double t, Parameter *parameter,
+void writeField(Field *field, int step, Parameter *parameter,
                 std::string const &parameterFilename = "Undefined",
                 std::string const &geometryFilename = "Undefined",
-                std::string const &filename = "result");
+                std::string const &filename = "result",
+                SubdomainInfo *subdomainInfo = NULL);
+
+bool selectOutput(Field *field, int first, int end, Parameter *parameter, std::vector<int> &selected);
+void gatherOutput(Field *globalField, Field *localField, Parameter *parameter, SubdomainInfo &subdomainInfo);
 
 void matlab(std::string const &filename,
             std::string const &parameterFilename,
             std::string const &geometryFilename,
-            int step, Parameter *parameter, Field *field);
+            int step, Parameter *parameter, Field *field,
+            std::vector<int> const &indices, int nFree, int nMoving, int nFixed, int piece = -1);
+
+// outputWriter.cpp
+void startOutputWriter(OutputWriter &writer, std::string const &parameterFilename,
+                       std::string const &geometryFilename, std::string const &filename,
+                       Parameter *parameter, SubdomainInfo &subdomainInfo);
+void queueOutput(OutputWriter &writer, Field *localField, Field *globalField, int step, double currentTime,
+                 Parameter *parameter, SubdomainInfo &subdomainInfo);
+void flushOutputWriter(OutputWriter &writer);
+void stopOutputWriter(OutputWriter &writer);
+
+// probes.cpp
+void startProbes(ProbeWriter &writer, std::string const &filename, std::string const &parameterFilename,
+                 Parameter *parameter, SubdomainInfo &subdomainInfo, double restartTime = -1.0);
+void sampleProbes(ProbeWriter &writer, Field *field, double currentTime, Parameter *parameter,
+                  SubdomainInfo &subdomainInfo, std::vector<std::vector<int>> &boxes,
+                  std::vector<std::vector<int>> &surrBoxesAll);
+void flushProbes(ProbeWriter &writer);
+
+// checkpoint.cpp
+void startCheckpoints(Checkpoint &checkpoint, std::string const &filename, std::string const &parameterFilename,
+                      std::string const &geometryFilename, SubdomainInfo &subdomainInfo, bool restart);
+double readWalltime(std::string const &value);
+bool checkpointDue(Checkpoint &checkpoint, unsigned int step, Parameter *parameter, SubdomainInfo &subdomainInfo,
+                   bool &stop);
+bool writeCheckpoint(Checkpoint &checkpoint, Field *field, Field *globalField, Parameter *parameter,
+                     SubdomainInfo &subdomainInfo);
+Error readCheckpoint(Checkpoint &checkpoint, Field *localField, Field *globalField, Parameter *parameter,
+                     SubdomainInfo &subdomainInfo);
 
 // ConsistencyCheck.cpp
 Error consistencyParameters(Parameter *param);
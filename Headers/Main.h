@@ -10,6 +10,7 @@
 #include <vector>
 #include <iostream>
 #include <cmath>
+#include <stdint.h>
 #include <cassert>
 #include <fstream>
 #include <ctime>
@@ -17,6 +18,9 @@
 #include <algorithm>
 #include <mpi.h>
 #include <omp.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 extern std::clock_t startExperimentTimeClock;
 
 #endif
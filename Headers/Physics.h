@@ -9,11 +9,11 @@
 // Geometry.cpp
 #include <random>
 void RotateVector(std::vector<double> &pos, double teta[3], int i);
-void meshcube(double o[3], double L[3], double teta[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation = 0.0, bool stack = false);
-void meshcylinder(double o[3], double L[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation = 0.0, bool stack = false);
+void meshcube(double o[3], double L[3], double teta[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation = 0.0, bool stack = false, SubdomainInfo *region = NULL);
+void meshcylinder(double o[3], double L[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation = 0.0, bool stack = false, SubdomainInfo *region = NULL);
 void meshsphere(double o[3], double L[3], double s, std::vector<double> &pos, int *nPart, double *volPart, double perturbation = 0.0, bool stack = false);
 Error meshBathymetry(char *batFile, int bathType, int numberGroundParticles, double height0, double hFreeSurface, double s, std::vector<double> &posFree, std::vector<double> &posFixed, int *nPartFree, int *nPartFixed, double *volPart,
-                     double perturbation, bool stack);
+                     double perturbation, bool stack, SubdomainInfo *region = NULL);
 
 // Neighborhood.cpp
 void neighborAllPair(std::vector<double> (&pos)[3],
@@ -53,6 +53,12 @@ void boxMesh(double l[3], double u[3], double kh,
              std::vector<std::vector<int>> &boxes,
              std::vector<std::vector<int>> &surrBoxesAll);
 double boxSizeCalc(double kh, IntegrationMethod method);
+void splitBoxes(std::vector<std::vector<int>> &boxes, std::vector<std::vector<int>> &surrBoxesAll,
+                int startingParticle, int endingParticle,
+                std::vector<int> &innerBoxes, std::vector<int> &edgeBoxes);
+
+// freeSurface.cpp
+void freeSurface(Field *field, int first, int end, Parameter *parameter, std::vector<int> &surface, bool normals);
 
 // TimeIntegration.cpp
 void timeIntegration(Field *currentField, Field *nextField, Parameter *parameter, SubdomainInfo &subdomainInfo,
@@ -69,7 +75,7 @@ double gethFromkh(Kernel kernelType, double kh);
 
 // Init.cpp
 void speedInit(Field *field, Parameter *parameter);
-void densityInit(Field *field, Parameter *parameter);
+void densityInit(Field *field, Parameter *parameter, MPI_Comm comm = MPI_COMM_SELF);
 void pressureInit(Field *field, Parameter *parameter);
 void pressureComputation(Field *field, Parameter *parameter, int particleID);
 void massInit(Field *field, Parameter *parameter, std::vector<double> &vol);
@@ -93,25 +99,38 @@ void viscosityComputation(int particleID, std::vector<int> &neighbors, Field *cu
 // MPI.cpp
 Error scatterField(Field *globalField, Field *currentField, Parameter *parameter,
                    SubdomainInfo &subdomainInfo);
-void gatherField(Field *globalField, Field *localField, SubdomainInfo &subdomainInfo);
+void gatherField(Field *globalField, Field *localField, SubdomainInfo &subdomainInfo,
+                 std::vector<int> const *particles = NULL, bool normals = false);
 void processUpdate(Field *currentField);
-int getDomainNumber(double x, std::vector<double> &limits, int nTasks);
-void computeDomainIndex(std::vector<double> &posX,
-                        std::vector<double> &limits, std::vector<int> &nbPartNode,
-                        std::vector<std::pair<int, int>> &index, int nTasks);
-void processUpdate(Field &localField, SubdomainInfo &subdomainInfo);
-void resizeField(Field &field, int nMigrate);
-void computeMigrateIndex(std::vector<double> &posX,
-                         std::vector<std::pair<int, int>> &index, int *nMigrate,
-                         double Xmin, double Xmax);
-void computeOverlapIndex(std::vector<double> &posX,
-                         std::vector<std::pair<int, int>> &index, int *nOverlap,
-                         double leftMinX, double leftMaxX, double rightMinX, double rightMaxX);
+int getDomainNumber(int box[3], SubdomainInfo &subdomainInfo);
+int getNeighborNumber(int proc, SubdomainInfo &subdomainInfo);
+void globalBox(Field &field, int particleID, SubdomainInfo &subdomainInfo, int box[3]);
+void positionBox(double pos[3], SubdomainInfo &subdomainInfo, int box[3]);
+bool ownsPosition(double x, double y, double z, SubdomainInfo *region);
+void computeDomainIndex(Field &field, SubdomainInfo &subdomainInfo, std::vector<int> &nbPartNode,
+                        std::vector<std::pair<int, int>> &index);
+void processUpdate(Field &localField, Parameter *parameter, SubdomainInfo &subdomainInfo);
+void shareFarMigrate(Field &field, std::vector<int> &farList, Parameter *parameter, SubdomainInfo &subdomainInfo);
+bool skinExceeded(Field &field, SubdomainInfo &subdomainInfo);
+void computeMigrateIndex(Field &field, SubdomainInfo &subdomainInfo,
+                         std::vector<std::pair<int, int>> &index, std::vector<int> &nMigrate);
+void computeOverlapIndex(Field &field, SubdomainInfo &subdomainInfo, std::vector<std::vector<int>> &sendList);
 void sortParticles(Field &field, std::vector<std::pair<int, int>> &index);
-void resizeField(Field &field, int nMigrate);
-void shareRKMidpoint(Field &field, SubdomainInfo &subdomainInfo);
-void shareOverlap(Field &field, SubdomainInfo &subdomainInfo);
+void startHaloUpdate(Field &field, SubdomainInfo &subdomainInfo);
+void waitHalos(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo);
+void initHaloRequests(SubdomainInfo &subdomainInfo);
+void freeHaloRequests(SubdomainInfo &subdomainInfo);
+void shareOverlap(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo);
 void deleteHalos(Field &field, SubdomainInfo &subdomainInfo);
 void timeStepUpdate(double &nextK, double &localProposition, SubdomainInfo &subdomainInfo);
+void bisectDomain(int a, int b, int lo[3], int hi[3], std::vector<double> &boxLoad,
+                  DecompositionMethod method, SubdomainInfo &subdomainInfo);
+void decomposeDomain(std::vector<double> &boxLoad, Parameter *parameter, SubdomainInfo &subdomainInfo);
+Error initDecomposition(Field &field, Parameter *parameter, SubdomainInfo &subdomainInfo);
+void setupLocalField(Field &localField, Parameter *parameter, SubdomainInfo &subdomainInfo);
+void subdomainBounds(Field &localField, SubdomainInfo &subdomainInfo);
+void countParticles(Field &field);
+void redistributeParticles(Field &field, SubdomainInfo &subdomainInfo);
+bool balanceLoad(Field &localField, Parameter *parameter, SubdomainInfo &subdomainInfo);
 
 #endif
@@ -14,6 +14,7 @@ enum Error
     parameterError,
     geometryError,
     consistencyError,
+    restartError,
     NB_ERROR_VALUE
 };
 
@@ -99,6 +100,7 @@ enum Matlab
 {
     noMatlab,
     fullMatlab,
+    binaryMatlab,
     NB_MATLAB_VALUE
 };
 
@@ -126,6 +128,48 @@ enum BathType
     txt = 1
 };
 
+// DecompositionMethod = MPI subdomains: slabs (along x) or bisection (recursive coordinate bisection)
+enum DecompositionMethod
+{
+    slabs,
+    bisection,
+    NB_DECOMPOSITION_VALUE
+};
+
+// ParallelOutput = how the processes write the results: gathered by process 0, one piece per process
+// (with a .pvtp index) or a single file written by all of them with MPI-IO
+enum ParallelOutput
+{
+    gatheredOutput,
+    pieceOutput,
+    mpiioOutput,
+    NB_PARALLELOUTPUT_VALUE
+};
+
+// BalanceMeasure = load used to move the subdomain boundaries: particleCount or computeTime
+enum BalanceMeasure
+{
+    particleCount,
+    computeTime,
+    NB_BALANCEMEASURE_VALUE
+};
+
+// ProbeType = kind of probe of the "#probe" section
+enum ProbeType
+{
+    pointProbe,
+    lineProbe,
+    planeProbe,
+    gaugeProbe
+};
+
+// Probe: positions where the free particles are interpolated (a gauge gives the elevation of the free surface along its vertical)
+struct Probe
+{
+    ProbeType type;
+    std::vector<double> pos[3];
+};
+
 struct Parameter
 {
     double kh;
@@ -161,6 +205,34 @@ struct Parameter
     std::vector<double> amplitude;
     Matlab matlab;
     Paraview paraview;
+    // Optional "#paral" section (parallel options)
+    DecompositionMethod decomposition = slabs;
+    int balanceInterval = 0;       // number of time steps between two rebalancing (0 = never)
+    double balanceTolerance = 0.1; // no rebalancing while max/mean load - 1 stays below it
+    BalanceMeasure balanceMeasure = particleCount;
+    int haloSkin = 0;              // extra layers of boxes in the halos (0 = migration at each time step)
+    int distributedInit = 0;       // 1 = each process generates only the particles of its subdomain
+    ParallelOutput parallelOutput = gatheredOutput;
+    // Optional "#outpt" section (output options)
+    int asyncWrite = 0;            // 1 = the results are written by a background thread
+    int compressionLevel = -1;     // zlib level of the .vtp files: -1 = default, 0 (none) to 9 (best)
+    int compressionFilter = 0;     // pre-compression filter of the .vtp arrays (see PFilter)
+    int directWrite = 0;           // 1 = the .vtp files bypass the page cache (O_DIRECT, Linux)
+    int staticBoundary = 0;        // 1 = fixed particles written once, 2 = apart at each output
+    int skipUnchanged = 0;         // 1 = the ParaView files of an unchanged output are not written
+    int archive = 0;               // 1 = the outputs are also appended to the columnar archive <name>_archive.bin
+    std::vector<double> roi;       // region of interest lx,ly,lz,ux,uy,uz of the outputs (empty = whole domain)
+    int stride = 1;                // only one particle out of stride is written
+    double minSpeed = 0.0;         // only the particles with a velocity norm of at least minSpeed are written
+    double minPressure = -HUGE_VAL; // only the particles with a pressure of at least minPressure are written
+    std::vector<std::string> fields = {"pressure", "density", "velocity"}; // arrays of the ParaView files
+    int freeSurface = 0;           // 1 = only the free-surface particles are written, 2 = with their normal
+    double surfaceThreshold = 0.8; // free surface where div(r) < surfaceThreshold * its bulk value
+    int checkpointInterval = 0;    // number of time steps between two checkpoints (0 = never)
+    double checkpointPeriod = 0.0; // wall-clock seconds between two checkpoints (0 = never)
+    // Optional "#probe" section (time series of interpolated values)
+    int probeInterval = 1;         // number of time steps between two samples of the probes
+    std::vector<Probe> probes;
 };
 
 struct Field
@@ -173,23 +245,91 @@ struct Field
     double u[3];
     double nextK = 0.0;
     double currentTime = 0.0;
+    bool outputSelected = false;    // the particles are already selected by the output filters (see selectOutput)
     std::vector<double> pos[3];
     std::vector<double> speed[3];
     std::vector<double> density;
     std::vector<double> pressure;
     std::vector<double> mass;
     std::vector<int> type;
+    std::vector<double> normal[3];  // normal of the free-surface particles (freeSurface = 2 outputs only)
 };
 
 struct SubdomainInfo
 {
     int procID;
     int nTasks;
-    int startingBox; 
-    int endingBox;
-    int startingParticle; 
-    int endingParticle;
+    int startingParticle;                           // always 0: particles of the subdomain first, then the halos
+    int endingParticle;                             // last particle of the subdomain
     double boxSize;
+    int haloDepth = 1;                              // layers of boxes in the halos (1 + haloSkin)
+    std::vector<double> skinPos[3];                 // positions of the particles at the last migration (haloSkin > 0)
+    double globalL[3];                              // lower bounds of the global domain
+    int nTotalBoxes[3];                             // number of boxes of the global domain in each direction
+    std::vector<int> cutAxis;                       // processes [a,b[ are split at mid=(a+b)/2 by a cut along cutAxis[mid]
+    std::vector<int> cutBox;                        // ... between the global boxes cutBox[mid]-1 and cutBox[mid]
+    std::vector<int> subdomainBoxes;                // first and last+1 global boxes of each subdomain (6 values per process)
+    std::vector<int> neighbors;                     // processes whose subdomain touches the halo of this one
+    std::vector<std::vector<int>> haloSendList;     // particles sent to each neighbor (counted from startingParticle)
+    std::vector<int> haloRecvStart;                 // first particle of the halo received from each neighbor
+    std::vector<int> haloRecvCount;                 // number of particles received from each neighbor
+    std::vector<std::vector<double>> sendBuffer;    // packed particles sent to each neighbor (reused)
+    std::vector<std::vector<double>> recvBuffer;    // packed particles received from each neighbor (reused)
+    std::vector<std::vector<double>> haloSendBuffer; // buffers of the persistent RK2 midpoint requests
+    std::vector<std::vector<double>> haloRecvBuffer;
+    std::vector<MPI_Request> haloRequests;           // persistent requests (receive and send for each neighbor)
+    std::vector<int> haloCounts;                     // neighbor, sent and received particles used to create them
+    bool haloPending = false;                        // RK2 midpoint exchange started but not completed
+    double computeTime = 0.0;                       // time spent in derivativeComputation since the last rebalancing
+    bool background = false;                        // piece written by the background writer (asyncWrite): no MPI call
+};
+
+// Background writer (asyncWrite): the solver fills one snapshot while the other one is written
+struct OutputWriter
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed;                // a snapshot was queued or written, or stop was set
+    Field snapshot[2];                              // particles to write (reused from one output to the next)
+    Parameter parameter[2];                         // parameters at the time of each snapshot
+    int step[2];
+    bool pending[2] = {false, false};               // snapshot queued and not written yet
+    int next = 0;                                   // snapshot filled by the next output
+    bool stop = false;
+    bool running = false;                           // the thread is started on the processes that write
+    SubdomainInfo *pieces = NULL;                   // not NULL if each process writes its own piece
+    std::string parameterFilename;
+    std::string geometryFilename;
+    std::string filename;
+};
+
+// Probes (#probe): sums of the SPH interpolation at each sampled position and time series of process 0
+struct ProbeWriter
+{
+    std::ofstream file;                             // opened by process 0 only
+    std::vector<int> probeStart;                    // first sampled position of each probe
+    std::vector<double> sums;                       // volume, density, pressure and velocity sums (6 per position)
+    std::vector<char> line;                         // formatted row (reused)
+    unsigned int rows = 0;                          // rows written since the last flush
+};
+
+// Checkpoint: state of the time loop saved with the particles of each process (see checkpoint.cpp)
+struct Checkpoint
+{
+    std::string filename;                           // Results/<filename>_checkpoint_<slot>_<process>.bin
+    int slot = 0;                                   // slot of the next checkpoint (0 or 1, the other one is kept)
+    uint64_t parameterHash = 0;                     // FNV-1a hashes of the input files
+    uint64_t geometryHash = 0;
+    unsigned int step = 0;                          // last time step done
+    double currentTime = 0.0;
+    unsigned int writeCount = 1;                    // next output
+    unsigned int loadingBar = 0;                    // progress bar (process 0)
+    double lastWrite = 0.0;                         // wall-clock time of the last checkpoint (process 0)
+    double walltime = 0.0;                          // wall-clock seconds allowed to the run (0 = no limit)
+    double start = 0.0;                             // wall-clock time of the start of the run (process 0)
+    double lastStep = 0.0;                          // wall-clock time of the end of the last time step (process 0)
+    double longestStep = 0.0;                       // longest time step and checkpoint write (process 0)
+    double longestWrite = 0.0;
 };
 
 #endif
@@ -44,4 +44,7 @@ void boxClear(std::vector<std::vector<int>> &boxes);
 void copyField(Field *sourceField, Field *copiedField);
 void swapField(Field **hopField, Field **cornField);
 
+// sizeField.cpp
+void sizeField(Field &field, int n);
+
 #endif
@@ -0,0 +1,91 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Columnar archive of the results (archive=1): the outputs of a run are appended to a single
+// file whose columns are read in place through a memory mapping (native byte order).
+//   file:  ArchiveHeader | frame | frame | ... | ArchiveEntry of each frame | ArchiveTrailer
+//   frame: ArchiveFrame | nbp doubles of each of the ARCHIVE_DOUBLES columns | nbp int32 types
+//          (padded to 8 bytes)
+// The offsets are 64-bit, counted from the start of the file; frames and columns are 8-byte aligned.
+
+enum ArchiveColumn
+{
+    ARCHIVE_POSX,
+    ARCHIVE_POSY,
+    ARCHIVE_POSZ,
+    ARCHIVE_SPEEDX,
+    ARCHIVE_SPEEDY,
+    ARCHIVE_SPEEDZ,
+    ARCHIVE_DENSITY,
+    ARCHIVE_PRESSURE,
+    ARCHIVE_MASS,
+    ARCHIVE_DOUBLES
+};
+
+struct ArchiveHeader
+{
+    char magic[8];    // "SPHARC1"
+    uint32_t version; // 1
+    uint32_t nDoubles; // ARCHIVE_DOUBLES
+};
+
+struct ArchiveFrame
+{
+    char magic[8];    // "SPHFRM1"
+    uint64_t size;    // bytes of the frame (this header included)
+    uint64_t nbp;     // number of particles
+    int64_t step;     // time step of the output
+    double time;      // physical time of the output
+};
+
+// frame index (a copy of the frame headers, read at once)
+struct ArchiveEntry
+{
+    uint64_t offset;  // of the ArchiveFrame
+    uint64_t nbp;
+    int64_t step;
+    double time;
+};
+
+struct ArchiveTrailer
+{
+    uint64_t index;   // offset of the first ArchiveEntry
+    uint64_t nFrames;
+    char magic[8];    // "SPHIDX1"
+};
+
+void archiveFrame(std::string const &filename, int step, double time,
+                  std::vector<double> const (&pos)[3], std::vector<double> const (&speed)[3],
+                  std::vector<double> const &density, std::vector<double> const &pressure,
+                  std::vector<double> const &mass, std::vector<int> const &type,
+                  std::vector<int> const &indices, bool create);
+
+// Read access to an archive: the columns of the frames are pointers into the mapped file
+class ArchiveReader
+{
+public:
+    ArchiveReader() {}
+    ArchiveReader(ArchiveReader const &) = delete;
+    ArchiveReader &operator=(ArchiveReader const &) = delete;
+    ~ArchiveReader() { close(); }
+    bool open(std::string const &name);
+    void close();
+    size_t frames() const { return index.size(); }
+    double time(size_t frame) const { return index[frame].time; }
+    int64_t step(size_t frame) const { return index[frame].step; }
+    size_t particles(size_t frame) const { return index[frame].nbp; }
+    double const *column(size_t frame, ArchiveColumn column) const;
+    int32_t const *type(size_t frame) const;
+
+private:
+    char const *data = NULL;          // mapped file
+    size_t size = 0;
+    std::vector<char> buffer;         // copy of the file where mmap is not available
+    std::vector<ArchiveEntry> index;
+};
+
+#endif
@@ -4,6 +4,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <ostream>
+#include <stdint.h>
+
+// The particles written by the functions below are indices[i] (or i if indices is NULL)
+// for i in [nbpStart, nbpEnd[: a subset of the arrays is written without being copied.
 
 enum PFormat
 {
@@ -13,12 +18,73 @@ enum PFormat
     XML_BINZ = 3
 };
 
-void paraview(std::string const &filename,
+// Pre-compression filter of the XML_BINZ arrays (the filtered files must be decoded
+// by vtpfilter before being opened in ParaView)
+enum PFilter
+{
+    NO_FILTER = 0,    // values given as such to zlib
+    SHUFFLE = 1,      // byte planes of the 4-byte values
+    SHUFFLE_DELTA = 2 // SHUFFLE + particles sorted by cell and positions delta coded
+};
+
+// Compression of the XML_BINZ format
+struct PCompression
+{
+    int level = -1;           // zlib level: -1 = default, 0 (none) to 9 (best)
+    size_t blockSize = 1 << 18; // uncompressed bytes per zlib block (blocks are compressed in parallel)
+    PFilter filter = NO_FILTER; // pre-compression filter
+    double cellSize = 0.0;      // size of the cells used to sort the particles (SHUFFLE_DELTA)
+};
+
+bool paraview(std::string const &filename,
               int step,
               std::vector<double> const (&pos)[3],
               std::map<std::string, std::vector<double> *> const &scalars,
               std::map<std::string, std::vector<double> (*)[3]> const &vectors,
               int nbpStart, int nbpEnd,
-              PFormat format);
+              std::vector<int> const *indices,
+              PFormat format, int piece = -1,
+              PCompression const &compression = PCompression(),
+              bool direct = false);
+
+bool paraviewIndex(std::string const &filename,
+                   int step, std::vector<int> const &pieces,
+                   std::map<std::string, std::vector<double> *> const &scalars,
+                   std::map<std::string, std::vector<double> (*)[3]> const &vectors);
+
+void paraviewMultiBlock(std::string const &filename,
+                        int step,
+                        std::vector<std::string> const &names,
+                        std::vector<std::string> const &files);
+
+void paraviewCollection(std::string const &filename,
+                        std::string const &file,
+                        double time,
+                        bool create);
+
+bool paraviewMPIIO(std::string const &filename,
+                   int step,
+                   std::vector<double> const (&pos)[3],
+                   std::map<std::string, std::vector<double> *> const &scalars,
+                   std::map<std::string, std::vector<double> (*)[3]> const &vectors,
+                   int nbpStart, int nbpEnd,
+                   std::vector<int> const *indices);
+
+// header + data + footer written in one pass (with O_DIRECT if direct, fsync if sync, see paraview.cpp)
+bool writeFile(std::string const &name, std::string const &header, std::vector<char> const &data,
+               std::string const &footer, bool direct, bool sync = false);
+
+// pre-compression filters (shared with the vtpfilter decoder)
+void shuffleBytes(char const *src, char *dst, size_t n);
+void unshuffleBytes(char const *src, char *dst, size_t n);
+void deltaEncode(uint32_t *values, size_t n, int dim);
+void deltaDecode(uint32_t *values, size_t n, int dim);
+void cellOrder(std::vector<double> const (&pos)[3], int nbpStart, int nbpEnd,
+               std::vector<int> const *indices, double cellSize, std::vector<int> &order);
+
+size_t write_blockXML(std::ostream &f, char const *data, size_t sourcelen, bool usez,
+                      PCompression const &compression);
+size_t write_filteredXML(std::ostream &f, uint32_t *values, size_t n, int dim, bool delta,
+                         bool usez, PCompression const &compression);
 
 #endif // PARAVIEW_H
@@ -0,0 +1,48 @@
+%**************************************************************************
+% Read a binary result file (matlab=2 in the parameter file):
+%     Experiment = readBinary('Results/result_00000100.bin')
+% Experiment.data has the same columns as importdata on the .txt file
+% (posX posY posZ velocityX velocityY velocityZ density pressure mass) and
+% Experiment.textdata the lines of its text header.
+%**************************************************************************
+function Experiment = readBinary(filename)
+
+fid = fopen(filename, 'r', 'ieee-le');
+if (fid < 0)
+    error(['Cannot open ', filename]);
+end
+
+magic = fread(fid, 8, '*char')';
+if (~strcmp(magic(1:7), 'SPHBIN1'))
+    fclose(fid);
+    error([filename, ' is not a binary result file']);
+end
+
+% Text header (same as the .txt file)
+headerLength = fread(fid, 1, 'uint32');
+header = fread(fid, headerLength, '*char')';
+Experiment.textdata = strsplit(header, '\n')';
+
+% Counts and metadata
+counts = fread(fid, 4, 'int32');
+values = fread(fid, 11, 'double');
+memories = fread(fid, 2, 'uint64');
+nbp = counts(1);
+Experiment.nFree = counts(2);
+Experiment.nMoving = counts(3);
+Experiment.nFixed = counts(4);
+Experiment.time = values(1);
+Experiment.k = values(2);
+Experiment.writeInterval = values(3);
+Experiment.T = values(4);
+Experiment.CPU_Time = values(5);
+Experiment.l = values(6:8);
+Experiment.u = values(9:11);
+Experiment.memory = memories(1);
+Experiment.memoryPeak = memories(2);
+
+% Columns of the particles
+Experiment.data = fread(fid, [nbp, 9], 'double');
+fclose(fid);
+
+end